@@ -0,0 +1,326 @@
+/*
+ * Offer Password (opass): fuzz_format.c
+ *
+ * Differential fuzz test for the password output functions. See: https://github.com/wiremoons/opass
+ *
+ * The original functions used by the default output are the reference: `get_random_password_str()`,
+ * `get_full_password_str()`, `with_spaces()` and `with_capitilised_words()` from `opass.c`. The program aborts
+ * on the first difference found from the code run by the coprocess and batch modes.
+ *
+ * Three kinds of check are made from the fuzz data:
+ *   - pipeline       : `get_formatted_password()` for every `enum password_format`, against the default output
+ *                      steps. Both sides draw from the `libc` backend seeded with the same value from the data;
+ *   - real passwords : 1 to 50 words taken from `words[]`, passed to `format.c` and the reference functions;
+ *   - raw strings    : printable characters of any length, to check the edge cases of the length calculations.
+ *
+ * Built as a libFuzzer target with clang, otherwise as a standalone program that runs every word count followed
+ * by a number of random inputs. Both are built with AddressSanitizer and UndefinedBehaviorSanitizer:
+ *
+ *   mkdir build && cd build && cmake -DOPASS_BUILD_FUZZ=ON .. && make && ctest
+ *
+ * MIT License
+ *
+ */
+
+#define _DEFAULT_SOURCE
+
+#include "../src/format.h"
+#include "../src/password.h"
+#include "../src/rng.h"
+
+#include <stdint.h>  /* uint8_t */
+#include <stdio.h>   /* open_memstream, fprintf */
+#include <stdlib.h>  /* abort, setenv, srandom */
+#include <string.h>  /* memcmp, memcpy, strlen */
+
+/** @note the arrays are defined in `opass.h` and their sizes checked by `main()` in `opass.c` */
+extern char const *words[];
+#define FUZZ_WORDS 1312
+#define FUZZ_MARKS 10
+#define FUZZ_MAX_WORDS 50
+/** @note longest raw string - so the spaced version still fits in `FORMAT_MAX_LEN` */
+#define FUZZ_MAX_RAW 190
+
+/** @var output captured from the reference functions, which print to stdout */
+static char *captured = NULL;
+static size_t captured_len = 0;
+static FILE *saved_stdout = NULL;
+
+/**
+ * @brief Send all stdout output to memory until `capture_end()` is called.
+ * @return no return
+ */
+static void capture_begin(void)
+{
+    fflush(stdout);
+    saved_stdout = stdout;
+    stdout = open_memstream(&captured, &captured_len);
+    if (NULL == stdout) {
+        stdout = saved_stdout;
+        fprintf(stderr, "Error: unable to capture stdout in file '%s' at line '%d'.\n", __FILE__, __LINE__);
+        abort();
+    }
+}
+
+/**
+ * @brief Restore stdout. The captured output is left in `captured` and must be freed by the caller.
+ * @return no return
+ */
+static void capture_end(void)
+{
+    fclose(stdout);
+    stdout = saved_stdout;
+}
+
+/**
+ * @brief Compare the reference and optimised output, reporting the input and aborting if they differ.
+ * @param what : the name of the function being checked.
+ * @param input : the password string passed to both functions.
+ * @param expected : output of the reference function.
+ * @param expected_len : length of `expected`.
+ * @param got : output of the optimised function.
+ * @param got_len : length of `got`.
+ * @return no return
+ */
+static void check_same(const char *what, const char *input, const char *expected, size_t expected_len,
+                       const char *got, size_t got_len)
+{
+    if (expected_len == got_len && memcmp(expected, got, got_len) == 0) {
+        return;
+    }
+    fprintf(stderr, "\nDIFFERENCE found in '%s' for input: '%s' (length %d)\n", what, input, (int)strlen(input));
+    fprintf(stderr, "  reference: '%.*s' (length %d)\n", (int)expected_len, expected, (int)expected_len);
+    fprintf(stderr, "  optimised: '%.*s' (length %d)\n", (int)got_len, got, (int)got_len);
+    abort();
+}
+
+/**
+ * @brief Run every reference function and its optimised version on one password string.
+ * @param password : the non empty password string to check.
+ * @return no return
+ */
+static void check_password(const char *password)
+{
+    size_t length = strlen(password);
+    char reference[FORMAT_MAX_LEN];
+    char optimised[FORMAT_MAX_LEN];
+    size_t optimised_len;
+
+    /* with_spaces() : outputs via show_password(), with colour turned off by `fuzz_init()` */
+    memcpy(reference, password, length + 1);
+    capture_begin();
+    with_spaces(reference);
+    capture_end();
+    optimised_len = format_spaced(password, length, optimised);
+    check_same("with_spaces", password, captured, captured_len, optimised, optimised_len);
+    free(captured);
+    captured = NULL;
+
+    /* with_capitilised_words() : alters the string in place */
+    memcpy(reference, password, length + 1);
+    memcpy(optimised, password, length + 1);
+    with_capitilised_words(reference);
+    format_capitalised(optimised, length);
+    check_same("with_capitilised_words", password, reference, strlen(reference), optimised, strlen(optimised));
+}
+
+/**
+ * @brief Check `get_formatted_password()` for every format against the steps used by the default output, with
+ * both sides drawing the same random numbers.
+ * @param wordsRequired : the number of three letter words to use.
+ * @param seed : the value the `libc` backend is seeded with before each side is run.
+ * @return no return
+ */
+static void check_pipeline(int wordsRequired, unsigned int seed)
+{
+    static const struct {
+        const char *name;
+        enum password_format format;
+    } formats[] = {
+        {"get_formatted_password (plain)", FORMAT_PLAIN},
+        {"get_formatted_password (spaced)", FORMAT_SPACED},
+        {"get_formatted_password (full)", FORMAT_FULL},
+        {"get_formatted_password (capitalised)", FORMAT_CAPITALISED},
+    };
+    char input[64];
+    char optimised[FORMAT_MAX_LEN];
+
+    snprintf(input, sizeof(input), "words=%d seed=%u", wordsRequired, seed);
+
+    for (size_t f = 0; f < sizeof(formats) / sizeof(formats[0]); f++) {
+        /* reference : the default output builds the words, then the full password from them */
+        srandom(seed);
+        char *newpass = get_random_password_str(wordsRequired, FUZZ_WORDS);
+        char *fullpass = get_full_password_str(newpass, FUZZ_MARKS);
+        const char *expected = NULL;
+        size_t expected_len = 0;
+
+        if (formats[f].format == FORMAT_PLAIN) {
+            expected = newpass;
+        } else if (formats[f].format == FORMAT_SPACED) {
+            capture_begin();
+            with_spaces(newpass);
+            capture_end();
+            expected = captured;
+            expected_len = captured_len;
+        } else {
+            if (formats[f].format == FORMAT_CAPITALISED) {
+                with_capitilised_words(fullpass);
+            }
+            expected = fullpass;
+        }
+        if (formats[f].format != FORMAT_SPACED) {
+            expected_len = strlen(expected);
+        }
+
+        srandom(seed);
+        size_t optimised_len = get_formatted_password(formats[f].format, wordsRequired, FUZZ_WORDS, FUZZ_MARKS,
+                                                      optimised);
+        check_same(formats[f].name, input, expected, expected_len, optimised, optimised_len);
+
+        free(captured);
+        captured = NULL;
+        free(newpass);
+        free(fullpass);
+    }
+}
+
+/**
+ * @brief Check a real password made from the given word count, taking word choices and the pipeline seed
+ * from `data`.
+ * @param wordsRequired : the number of three letter words to use.
+ * @param data : the fuzz input bytes - reused from the start if more are needed.
+ * @param size : the number of bytes in `data` - must not be zero.
+ * @return no return
+ */
+static void check_words(int wordsRequired, const uint8_t *data, size_t size)
+{
+    char password[FORMAT_MAX_LEN];
+    size_t pos = 0;
+    size_t len = 0;
+    unsigned int seed = 0;
+
+    for (int x = 0; x < wordsRequired; x++) {
+        unsigned int r = ((unsigned int)data[pos % size] << 8) | data[(pos + 1) % size];
+        pos += 2;
+        memcpy(password + len, words[r % FUZZ_WORDS], 3);
+        len += 3;
+    }
+    password[len] = '\0';
+    check_password(password);
+
+    for (size_t i = 0; i < 4; i++) {
+        seed = (seed << 8) | data[i % size];
+    }
+    check_pipeline(wordsRequired, seed);
+}
+
+/**
+ * @brief Set up the state shared by every input: colour output off so `with_spaces()` prints the string itself,
+ * and the `libc` backend so each side of `check_pipeline()` can be seeded with the same value.
+ * @return no return
+ */
+static void fuzz_init(void)
+{
+    static int done = 0;
+
+    if (done) {
+        return;
+    }
+    done = 1;
+    setenv("NO_COLOR", "1", 1);
+    if (rng_select("libc") != 0) {
+        fprintf(stderr, "Error: unable to select the 'libc' random number generator in file '%s' at line '%d'.\n",
+                __FILE__, __LINE__);
+        abort();
+    }
+}
+
+/**
+ * @brief libFuzzer entry point. The first byte selects the input kind and the word count.
+ * @param data : the fuzz input bytes.
+ * @param size : the number of bytes in `data`.
+ * @return int : always zero.
+ */
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    if (size < 2) {
+        return 0;
+    }
+    fuzz_init();
+
+    if (data[0] & 0x80) {
+        char raw[FUZZ_MAX_RAW + 1];
+        size_t len = (size - 1) < FUZZ_MAX_RAW ? (size - 1) : FUZZ_MAX_RAW;
+        for (size_t i = 0; i < len; i++) {
+            /* printable ASCII only - the characters a password can hold */
+            raw[i] = (char)(' ' + (data[i + 1] % 95));
+        }
+        raw[len] = '\0';
+        check_password(raw);
+    } else {
+        check_words((data[0] % FUZZ_MAX_WORDS) + 1, data + 1, size - 1);
+    }
+    return 0;
+}
+
+#if OPASS_FUZZ_STANDALONE
+/**
+ * @brief Standalone driver used when libFuzzer is not available. Any files given are run as inputs, otherwise
+ * every word count is checked followed by random inputs.
+ * @param argc : number of arguments included when the program was executed.
+ * @param argv : the number of random inputs to run (default 100000), or a list of input files.
+ * @return : int indicating success - any difference found aborts the program.
+ */
+int main(int argc, char **argv)
+{
+    uint8_t data[FUZZ_MAX_RAW + 2];
+    long runs = 100000;
+
+    if (argc > 1) {
+        char *end = NULL;
+        long value = strtol(argv[1], &end, 10);
+        if (*end != '\0') {
+            for (int i = 1; i < argc; i++) {
+                FILE *input = fopen(argv[i], "rb");
+                if (NULL == input) {
+                    fprintf(stderr, "Error: unable to open input file '%s'.\n", argv[i]);
+                    return EXIT_FAILURE;
+                }
+                size_t size = fread(data, 1, sizeof(data), input);
+                fclose(input);
+                LLVMFuzzerTestOneInput(data, size);
+            }
+            return EXIT_SUCCESS;
+        }
+        runs = value;
+    }
+
+    /* fixed seed so any failure can be repeated */
+    srand(1);
+
+    /* every word count, and every raw string length */
+    for (int w = 0; w < FUZZ_MAX_WORDS; w++) {
+        for (size_t i = 0; i < sizeof(data); i++) {
+            data[i] = (uint8_t)rand();
+        }
+        data[0] = (uint8_t)w;
+        LLVMFuzzerTestOneInput(data, sizeof(data));
+    }
+    for (size_t len = 2; len <= FUZZ_MAX_RAW + 1; len++) {
+        data[0] = 0x80;
+        LLVMFuzzerTestOneInput(data, len);
+    }
+
+    for (long run = 0; run < runs; run++) {
+        size_t size = 2 + ((size_t)rand() % (sizeof(data) - 1));
+        for (size_t i = 0; i < size; i++) {
+            data[i] = (uint8_t)rand();
+        }
+        LLVMFuzzerTestOneInput(data, size);
+    }
+
+    printf("opass_fuzz: no differences found in %ld random inputs.\n", runs);
+    return EXIT_SUCCESS;
+}
+#endif
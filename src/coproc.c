@@ -0,0 +1,175 @@
+/*
+ * Offer Password (opass): coproc.c
+ *
+ * Coprocess mode, run via command line option '--coproc'. See: https://github.com/wiremoons/opass
+ *
+ * One request is read per line from stdin, made up of optional space separated `key=value` settings:
+ *
+ *   words=<1-50>                               number of three letter words (default: OPASS_WORDS or 3)
+ *   count=<1-100000>                           number of passwords to return (default: 1)
+ *   format=plain|spaced|full|capitalised       output style of each password (default: plain)
+ *
+ * An empty line uses all the defaults. Each response starts with a header line, and stdout is flushed once the
+ * whole response is written:
+ *
+ *   OK <count>        followed by exactly <count> lines, one password per line
+ *   ERR <message>     the request was not understood, or the history store has no new password left for the
+ *                     number of words requested - no further lines follow
+ *
+ * Should the history store run out part way through a response, the passwords written so far are flushed and
+ * the program exits with an error on stderr, rather than send fewer lines than promised.
+ *
+ * The program exits when stdin is closed, or a line containing only `quit` is read.
+ *
+ * MIT License
+ *
+ */
+
+#include "coproc.h"
+#include "format.h"
+#include "password.h"
+#include "history.h"
+
+#include <stdio.h>   /* fgets, fwrite, fflush */
+#include <stdlib.h>  /* strtol, exit */
+#include <string.h>  /* strchr, strcmp, strlen */
+
+/**
+ * @brief Convert the text of a request setting to a number, checking it is within range.
+ * @param value : the text following the `=` in a request setting.
+ * @param min : the smallest number allowed.
+ * @param max : the largest number allowed.
+ * @param result : set to the number found if valid.
+ * @return int : zero on success, or minus one (-1) if the text is not a number in range.
+ */
+static int parse_number(const char *value, long min, long max, int *result)
+{
+    char *end = NULL;
+    long number = strtol(value, &end, 10);
+
+    if (end == value || *end != '\0' || number < min || number > max) {
+        return -1;
+    }
+    *result = (int)number;
+    return 0;
+}
+
+/**
+ * @brief Generate and write the passwords for one request to stdout.
+ * @param wordsRequired : the number of three letter words in each password.
+ * @param count : the number of passwords to write.
+ * @param format : the output style used for each password.
+ * @param wordArraySize : the size of the `char const *words[]` array.
+ * @param marksArraySize : the size of the `int const marks[]` array.
+ * @return no return
+ */
+static void write_passwords(int wordsRequired, int count, enum password_format format, int wordArraySize,
+                            int marksArraySize)
+{
+    char line[FORMAT_MAX_LEN];
+
+    /* the first password is generated before the header, so a history store already full for this number of
+     * words is answered with an error the client can act on */
+    size_t length = get_formatted_password(format, wordsRequired, wordArraySize, marksArraySize, line);
+    if (length == 0) {
+        printf("ERR no password left that is not in the history store - increase words\n");
+        return;
+    }
+
+    printf("OK %d\n", count);
+
+    for (int x = 1; x <= count; x++) {
+        if (x > 1) {
+            length = get_formatted_password(format, wordsRequired, wordArraySize, marksArraySize, line);
+        }
+        if (length == 0) {
+            /* the response can no longer hold the promised number of passwords - end the session, keeping
+             * those already written */
+            fflush(stdout);
+            fprintf(stderr,
+                    "Error: unable to generate a password not already in the history store after '%d' attempts.\n"
+                    "Increase the number of words in the request via 'words='.\n",
+                    HISTORY_MAX_ATTEMPTS);
+            exit(EXIT_FAILURE);
+        }
+        line[length++] = '\n';
+        fwrite(line, 1, length, stdout);
+    }
+}
+
+/**
+ * @brief Run as a coprocess, answering password requests read from stdin until it is closed.
+ * @param wordsRequired : the number of three letter words used when a request does not include `words=`.
+ * @param wordArraySize : the size of the `char const *words[]` array.
+ * @param marksArraySize : the size of the `int const marks[]` array.
+ * @return no return
+ */
+void run_coproc(int wordsRequired, int wordArraySize, int marksArraySize)
+{
+    char request[COPROC_MAX_LINE];
+
+    set_history_store();
+
+    while (fgets(request, sizeof(request), stdin) != NULL) {
+        char *newline = strchr(request, '\n');
+
+        if (NULL == newline && !feof(stdin)) {
+            /* discard the remainder of an over long request */
+            int c;
+            while ((c = getchar()) != EOF && c != '\n') {
+            }
+            printf("ERR request longer than %d characters\n", COPROC_MAX_LINE - 2);
+            fflush(stdout);
+            continue;
+        }
+        if (NULL != newline) {
+            *newline = '\0';
+        }
+        /* remove the '\r' of a request ended with CRLF so 'quit' is still recognised */
+        size_t length = strlen(request);
+        if (length > 0 && request[length - 1] == '\r') {
+            request[length - 1] = '\0';
+        }
+        if (strcmp(request, "quit") == 0) {
+            break;
+        }
+
+        int words = wordsRequired;
+        int count = 1;
+        enum password_format format = FORMAT_PLAIN;
+        const char *error = NULL;
+
+        for (char *setting = strtok(request, " \t\r"); setting != NULL && error == NULL;
+             setting = strtok(NULL, " \t\r")) {
+            char *value = strchr(setting, '=');
+            if (NULL == value) {
+                error = "setting must be given as key=value";
+                break;
+            }
+            *value++ = '\0';
+
+            if (strcmp(setting, "words") == 0) {
+                if (parse_number(value, 1, 50, &words) != 0) {
+                    error = "words must be a number from 1 to 50";
+                }
+            } else if (strcmp(setting, "count") == 0) {
+                if (parse_number(value, 1, COPROC_MAX_COUNT, &count) != 0) {
+                    error = "count must be a number from 1 to 100000";
+                }
+            } else if (strcmp(setting, "format") == 0) {
+                if (format_from_name(value, &format) != 0) {
+                    error = "format must be one of: plain spaced full capitalised";
+                }
+            } else {
+                error = "unknown setting - use words, count or format";
+            }
+        }
+
+        if (NULL != error) {
+            printf("ERR %s\n", error);
+        } else {
+            write_passwords(words, count, format, wordArraySize, marksArraySize);
+        }
+        fflush(stdout);
+    }
+}
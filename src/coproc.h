@@ -0,0 +1,28 @@
+/**
+ * @file coproc.h
+ * @brief Offer Password (opass): coprocess mode - a long running opass that answers password requests read
+ * line by line from stdin.
+ *
+ * @author:     simon rowe <simon@wiremoons.com>
+ * @license:    open-source released under "MIT License"
+ * @source:     https://github.com/wiremoons/opass
+ *
+ * @date originally created: 18 Oct 2026
+ *
+ * The program is licensed under the "*MIT License*" see
+ * http://opensource.org/licenses/MIT for more details.
+ *
+ */
+
+#ifndef OPASS_COPROC_H
+#define OPASS_COPROC_H
+
+/** @note longest request line accepted, including the newline */
+#define COPROC_MAX_LINE 1024
+/** @note largest number of passwords that can be asked for in a single request */
+#define COPROC_MAX_COUNT 100000
+
+void run_coproc(int wordsRequired, int wordArraySize, int marksArraySize);
+
+
+#endif //OPASS_COPROC_H
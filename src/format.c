@@ -0,0 +1,85 @@
+/*
+ * Offer Password (opass): format.c
+ *
+ * Buffer based versions of the password output styles. See: https://github.com/wiremoons/opass
+ *
+ * These produce the same strings as `with_spaces()` and `with_capitilised_words()` in `opass.c`, but work on a
+ * known length and write to a caller provided buffer without per character output. They are used by
+ * `get_formatted_password()` in `opass.c`, which also generates the password words into stack buffers, so the
+ * coprocess and batch modes use no heap memory per password. The `opass_fuzz` target checks every format of
+ * `get_formatted_password()` stays identical to the default output.
+ *
+ * MIT License
+ *
+ */
+
+#include "format.h"
+
+#include <ctype.h>   /* toupper */
+#include <string.h>  /* strcmp */
+
+/**
+ * @brief Convert an output style name into its `enum password_format` value.
+ * @param name : one of 'plain', 'spaced', 'full' or 'capitalised'.
+ * @param format : set to the matching format if the name is known.
+ * @return int : zero on success, or minus one (-1) if the name is not known.
+ */
+int format_from_name(const char *name, enum password_format *format)
+{
+    static const struct {
+        const char *name;
+        enum password_format format;
+    } names[] = {
+        {"plain", FORMAT_PLAIN},
+        {"spaced", FORMAT_SPACED},
+        {"full", FORMAT_FULL},
+        {"capitalised", FORMAT_CAPITALISED},
+    };
+
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if (strcmp(name, names[i].name) == 0) {
+            *format = names[i].format;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Copy a password adding a space after every third character, except after the last word.
+ * @param str_password : the password string of three letter words.
+ * @param length : the length of `str_password`.
+ * @param out : buffer for the new string - must hold at least `length + (length / 3) + 1` chars.
+ * @return size_t : the length of the new string, not including the `\0`.
+ */
+size_t format_spaced(const char *str_password, size_t length, char *out)
+{
+    size_t snp = 0;
+
+    for (size_t sp = 0; sp < length; sp++) {
+        out[snp++] = str_password[sp];
+        /* a space after each whole word, unless it is the final word in the string */
+        if ((sp % 3 == 2) && (sp + 1 < length)) {
+            out[snp++] = ' ';
+        }
+    }
+    out[snp] = '\0';
+    return snp;
+}
+
+/**
+ * @brief Capitalise the first letter of each three letter word in a full password, in place.
+ * @param str_password : the password string to be altered.
+ * @param length : the length of `str_password`.
+ * @return no return.
+ */
+void format_capitalised(char *str_password, size_t length)
+{
+    for (size_t sp = 0; sp < length; sp += 3) {
+        /* the position three from the end holds the mark in a full password, so is left alone */
+        if (sp != 0 && sp == length - 3) {
+            continue;
+        }
+        str_password[sp] = (char)toupper((unsigned char)str_password[sp]);
+    }
+}
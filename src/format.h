@@ -0,0 +1,40 @@
+/**
+ * @file format.h
+ * @brief Offer Password (opass): build the different password output styles into a caller provided buffer,
+ * without heap allocation or screen output, for use when many passwords are generated at once.
+ *
+ * @author:     simon rowe <simon@wiremoons.com>
+ * @license:    open-source released under "MIT License"
+ * @source:     https://github.com/wiremoons/opass
+ *
+ * @date originally created: 18 Oct 2026
+ *
+ * The program is licensed under the "*MIT License*" see
+ * http://opensource.org/licenses/MIT for more details.
+ *
+ */
+
+#ifndef OPASS_FORMAT_H
+#define OPASS_FORMAT_H
+
+#include <stddef.h>
+
+/** @note largest formatted password: 50 words, 49 spaces, a mark, two digits and the `\0` */
+#define FORMAT_MAX_LEN 256
+
+/**
+ *  `enum password_format` : the password output styles that can be requested.
+ */
+enum password_format {
+    FORMAT_PLAIN,       /* three letter words only - as output by '-q' */
+    FORMAT_SPACED,      /* three letter words separated by spaces */
+    FORMAT_FULL,        /* three letter words, a mark and a two digit number */
+    FORMAT_CAPITALISED  /* as FORMAT_FULL with each word capitalised */
+};
+
+int format_from_name(const char *name, enum password_format *format);
+size_t format_spaced(const char *str_password, size_t length, char *out);
+void format_capitalised(char *str_password, size_t length);
+
+
+#endif //OPASS_FORMAT_H
@@ -0,0 +1,652 @@
+/*
+ * Offer Password (opass): history.c
+ *
+ * Persistent history of issued passwords shared between runs of opass. See: https://github.com/wiremoons/opass
+ *
+ * The history store is one memory mapped file made up of:
+ *   - a 64 byte header;
+ *   - a blocked Bloom filter, with one 64 byte block for every `HISTORY_SLOTS_PER_BLOCK` table slots;
+ *   - an open addressed hash table of every password digest added, used to confirm a Bloom filter match.
+ *
+ * Passwords are never written to disk. Each one is reduced to a 64 bit SipHash-2-4 digest, keyed with a random
+ * key created when the store is first initialised. Checking and adding a digest costs one Bloom filter block and
+ * a short linear probe of the table, however many passwords are held. Once the table is half full the store is
+ * doubled in size and rebuilt from its digests. The digests are first saved to `<path>.grow`, so a store whose
+ * rebuild was interrupted is completed from that file the next time it is used.
+ *
+ * All access is serialised with an exclusive `flock()` on the store, so concurrent `opass` processes can share
+ * the same store safely. As `flock()` locks are shared by every thread using the same open file, a mutex also
+ * serialises the threads of one process.
+ *
+ * MIT License
+ *
+ */
+
+#define _DEFAULT_SOURCE
+
+#include "history.h"
+
+#include <stdio.h>   /* fprintf, snprintf */
+#include <stdlib.h>  /* exit, malloc */
+#include <string.h>  /* strlen, strerror, memcmp */
+#include <errno.h>   /* errno */
+#include <stdint.h>  /* uint64_t */
+
+#if defined(_WIN32)
+
+/* the history store depends on `mmap()` and `flock()` which are not available on Windows */
+
+int history_open(const char *path, int create)
+{
+    (void)create;
+    fprintf(stderr, "Error: password history store '%s' is not supported on this platform.\n", path);
+    exit(EXIT_FAILURE);
+}
+
+int history_check_and_add(const char *password)
+{
+    (void)password;
+    return 0;
+}
+
+int history_check_and_add_batch(const char *const *passwords, int count, int *found)
+{
+    (void)passwords;
+    for (int i = 0; i < count; i++) {
+        found[i] = 0;
+    }
+    return 0;
+}
+
+long history_entries(void)
+{
+    return -1;
+}
+
+void history_close(void)
+{
+}
+
+#else
+
+#include <fcntl.h>     /* open */
+#include <unistd.h>    /* read, write, pread, pwrite, ftruncate, fsync, unlink, close */
+#include <sys/file.h>  /* flock */
+#include <sys/mman.h>  /* mmap, msync, munmap */
+#include <sys/stat.h>  /* fstat */
+#include <pthread.h>   /* pthread_mutex_lock */
+
+#define HISTORY_MAGIC "OPASSHB2"
+#define HISTORY_VERSION 2
+#define HISTORY_BLOCK_WORDS 8
+
+/**
+ * @brief On disk header of the history store. Exactly one 64 byte block so the Bloom filter blocks that follow
+ * are cache line aligned in the mapping.
+ */
+struct history_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t growing;     /* set while the store is being rebuilt at a new size - see `store_grow()` */
+    uint64_t key[2];
+    uint64_t entries;
+    uint64_t num_slots;   /* size of the hash table - always a power of two */
+    uint64_t generation;  /* incremented each time the store changes size, so other processes remap it */
+    uint64_t reserved;
+};
+
+/** @var state of the currently open history store - only one is used per program run */
+static struct {
+    const char *path;
+    char *grow_path;
+    int fd;
+    size_t map_size;
+    uint64_t generation;
+    struct history_header *header;
+    uint64_t *blocks;
+    uint64_t *slots;
+} store = {NULL, NULL, -1, 0, 0, NULL, NULL, NULL};
+
+/** @var serialises threads checking the store - see `--jobs` */
+static pthread_mutex_t store_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/** @var set by `history_open()` before any worker thread is started, and cleared by `history_close()` once they
+ * have been joined, so it is read without the lock to skip all locking when no store is in use */
+static int store_enabled = 0;
+
+/** @var salts used to select one bit in each 64 bit word of a Bloom filter block */
+static const uint32_t bloom_salt[HISTORY_BLOCK_WORDS] = {
+    0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+    0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U};
+
+#define ROTL64(x, b) (uint64_t)(((x) << (b)) | ((x) >> (64 - (b))))
+
+#define SIPROUND                                                                  \
+    do {                                                                          \
+        v0 += v1; v1 = ROTL64(v1, 13); v1 ^= v0; v0 = ROTL64(v0, 32);             \
+        v2 += v3; v3 = ROTL64(v3, 16); v3 ^= v2;                                  \
+        v0 += v3; v3 = ROTL64(v3, 21); v3 ^= v0;                                  \
+        v2 += v1; v1 = ROTL64(v1, 17); v1 ^= v2; v2 = ROTL64(v2, 32);             \
+    } while (0)
+
+/**
+ * @brief Keyed SipHash-2-4 of the provided bytes.
+ * @param key : the 128 bit key held in the history store header.
+ * @param data : the bytes to be hashed.
+ * @param len : the number of bytes in `data`.
+ * @return the 64 bit digest.
+ */
+static uint64_t siphash24(const uint64_t key[2], const unsigned char *data, size_t len)
+{
+    uint64_t v0 = 0x736f6d6570736575ULL ^ key[0];
+    uint64_t v1 = 0x646f72616e646f6dULL ^ key[1];
+    uint64_t v2 = 0x6c7967656e657261ULL ^ key[0];
+    uint64_t v3 = 0x7465646279746573ULL ^ key[1];
+    uint64_t b = ((uint64_t)len) << 56;
+    size_t left = len & 7;
+    const unsigned char *end = data + (len - left);
+
+    for (; data != end; data += 8) {
+        uint64_t m = 0;
+        for (int i = 0; i < 8; i++) {
+            m |= ((uint64_t)data[i]) << (8 * i);
+        }
+        v3 ^= m;
+        SIPROUND;
+        SIPROUND;
+        v0 ^= m;
+    }
+
+    for (size_t i = 0; i < left; i++) {
+        b |= ((uint64_t)data[i]) << (8 * i);
+    }
+
+    v3 ^= b;
+    SIPROUND;
+    SIPROUND;
+    v0 ^= b;
+    v2 ^= 0xff;
+    SIPROUND;
+    SIPROUND;
+    SIPROUND;
+    SIPROUND;
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+/**
+ * @brief Fill the provided buffer from the operating systems random device - used to create a new store key.
+ * @param buf : the buffer to fill.
+ * @param len : the number of bytes required.
+ * @return no return
+ */
+static void fill_key(void *buf, size_t len)
+{
+    int fd = open("/dev/urandom", O_RDONLY);
+    size_t got = 0;
+
+    while (fd >= 0 && got < len) {
+        ssize_t n = read(fd, (char *)buf + got, len - got);
+        if (n <= 0) {
+            break;
+        }
+        got += (size_t)n;
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    if (got != len) {
+        fprintf(stderr,
+                "Error reading '/dev/urandom' in function 'fill_key()' in file '%s' at line '%d'.\nERROR : %s\n",
+                __FILE__, __LINE__, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * @brief Report a failure with the history store and exit the program.
+ * @param what : description of the action that failed.
+ * @param path : the history store file involved.
+ * @return no return
+ */
+static void history_fail(const char *what, const char *path)
+{
+    fprintf(stderr, "Error: unable to %s password history store '%s'.\nERROR : %s\n", what, path, strerror(errno));
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * @brief Size of a history store file holding a hash table of `num_slots` slots.
+ * @param num_slots : the number of hash table slots.
+ * @return size_t : the file size in bytes.
+ */
+static size_t store_size(uint64_t num_slots)
+{
+    return sizeof(struct history_header) +
+           (size_t)(num_slots / HISTORY_SLOTS_PER_BLOCK) * HISTORY_BLOCK_WORDS * sizeof(uint64_t) +
+           (size_t)num_slots * sizeof(uint64_t);
+}
+
+/**
+ * @brief Map the whole store file into memory at the size given in its header, replacing any earlier mapping.
+ * @return no return
+ */
+static void store_map(void)
+{
+    struct history_header header;
+
+    if (NULL != store.header) {
+        munmap(store.header, store.map_size);
+        store.header = NULL;
+    }
+    if (pread(store.fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header)) {
+        history_fail("read", store.path);
+    }
+
+    size_t map_size = store_size(header.num_slots);
+    void *map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, store.fd, 0);
+    if (map == MAP_FAILED) {
+        history_fail("map", store.path);
+    }
+    store.map_size = map_size;
+    store.header = map;
+    store.blocks = (uint64_t *)(store.header + 1);
+    store.slots = store.blocks + (header.num_slots / HISTORY_SLOTS_PER_BLOCK) * HISTORY_BLOCK_WORDS;
+    store.generation = header.generation;
+}
+
+/**
+ * @brief Add a digest to the Bloom filter and hash table. The caller has checked it is not already held.
+ * @param digest : the keyed hash of a password - never zero, as zero marks an empty slot.
+ * @return no return
+ */
+static void store_insert(uint64_t digest)
+{
+    uint64_t num_blocks = store.header->num_slots / HISTORY_SLOTS_PER_BLOCK;
+    uint64_t *block = store.blocks + (((digest >> 32) & (num_blocks - 1)) * HISTORY_BLOCK_WORDS);
+    uint64_t mask = store.header->num_slots - 1;
+
+    for (int i = 0; i < HISTORY_BLOCK_WORDS; i++) {
+        block[i] |= 1ULL << ((uint32_t)((uint32_t)digest * bloom_salt[i]) >> 26);
+    }
+    for (uint64_t slot = digest & mask;; slot = (slot + 1) & mask) {
+        if (store.slots[slot] == 0) {
+            store.slots[slot] = digest;
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Check the Bloom filter, then if needed the hash table, for a digest.
+ * @param digest : the keyed hash of a password - never zero.
+ * @return int : one if the digest is held, otherwise zero.
+ */
+static int store_contains(uint64_t digest)
+{
+    uint64_t num_blocks = store.header->num_slots / HISTORY_SLOTS_PER_BLOCK;
+    uint64_t *block = store.blocks + (((digest >> 32) & (num_blocks - 1)) * HISTORY_BLOCK_WORDS);
+    uint64_t mask = store.header->num_slots - 1;
+
+    for (int i = 0; i < HISTORY_BLOCK_WORDS; i++) {
+        if ((block[i] & (1ULL << ((uint32_t)((uint32_t)digest * bloom_salt[i]) >> 26))) == 0) {
+            return 0;
+        }
+    }
+    /* the table is never more than half full, so an empty slot is always found */
+    for (uint64_t slot = digest & mask; store.slots[slot] != 0; slot = (slot + 1) & mask) {
+        if (store.slots[slot] == digest) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Rebuild the store at the size now given in its header from a list of digests. Truncating the file first
+ * lets the operating system zero the Bloom filter and hash table without writing to every page.
+ * @param digests : every digest held in the store.
+ * @param count : the number of digests.
+ * @return no return
+ */
+static void store_rebuild(const uint64_t *digests, uint64_t count)
+{
+    uint64_t num_slots = store.header->num_slots;
+
+    munmap(store.header, store.map_size);
+    store.header = NULL;
+    if (ftruncate(store.fd, (off_t)sizeof(struct history_header)) != 0 ||
+        ftruncate(store.fd, (off_t)store_size(num_slots)) != 0) {
+        history_fail("resize", store.path);
+    }
+    store_map();
+
+    for (uint64_t i = 0; i < count; i++) {
+        store_insert(digests[i]);
+    }
+    store.header->entries = count;
+    store.header->generation++;
+    store.generation = store.header->generation;
+    store.header->growing = 0;
+    msync(store.header, store.map_size, MS_SYNC);
+}
+
+/**
+ * @brief Complete a rebuild that was interrupted, using the digests saved to `<path>.grow` before it started.
+ * @return no return
+ */
+static void store_recover(void)
+{
+    int fd = open(store.grow_path, O_RDONLY);
+    struct stat st;
+
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        history_fail("recover", store.grow_path);
+    }
+
+    uint64_t count = (uint64_t)st.st_size / sizeof(uint64_t);
+    uint64_t *digests = malloc((size_t)(count + 1) * sizeof(uint64_t));
+    if (NULL == digests) {
+        history_fail("recover", store.grow_path);
+    }
+    if (pread(fd, digests, (size_t)count * sizeof(uint64_t), 0) != (ssize_t)(count * sizeof(uint64_t))) {
+        history_fail("recover", store.grow_path);
+    }
+    close(fd);
+
+    store_rebuild(digests, count);
+    free(digests);
+    unlink(store.grow_path);
+}
+
+/**
+ * @brief Double the size of the store. Every digest is saved to `<path>.grow` and flushed to disk before the
+ * store is marked as growing, so an interrupted rebuild can always be completed by `store_recover()`.
+ * @return no return
+ */
+static void store_grow(void)
+{
+    uint64_t count = 0;
+    uint64_t *digests = malloc((size_t)(store.header->entries + 1) * sizeof(uint64_t));
+
+    if (NULL == digests) {
+        history_fail("grow", store.path);
+    }
+    for (uint64_t slot = 0; slot < store.header->num_slots; slot++) {
+        if (store.slots[slot] != 0) {
+            digests[count++] = store.slots[slot];
+        }
+    }
+
+    int fd = open(store.grow_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0 || write(fd, digests, (size_t)count * sizeof(uint64_t)) != (ssize_t)(count * sizeof(uint64_t)) ||
+        fsync(fd) != 0) {
+        history_fail("grow", store.grow_path);
+    }
+    close(fd);
+
+    store.header->num_slots *= 2;
+    store.header->growing = 1;
+    msync(store.header, store.map_size, MS_SYNC);
+
+    store_rebuild(digests, count);
+    free(digests);
+    unlink(store.grow_path);
+}
+
+/**
+ * @brief Bring this processes view of the store up to date once the lock is held - completing a rebuild left
+ * unfinished by another process, or remapping a store another process has grown.
+ * @return no return
+ */
+static void store_refresh(void)
+{
+    if (store.header->growing) {
+        store_recover();
+    } else if (store.header->generation != store.generation) {
+        store_map();
+    }
+}
+
+/**
+ * @brief Open, or optionally create when it does not exist, the history store held at `path`.
+ * @param path : the location of the history store file. Must remain valid until `history_close()` is called.
+ * @param create : non zero to create the store if it does not exist, or zero to only open an existing store.
+ * @return int : zero on success, or minus one (-1) if `create` is zero and no store exists at `path`. Any other
+ * failure is reported and the program exits - including a file at `path` that is not a history store.
+ */
+int history_open(const char *path, int create)
+{
+    struct history_header header;
+    struct stat st;
+
+    store.path = path;
+    size_t grow_sz = strlen(path) + sizeof(".grow");
+    store.grow_path = malloc(grow_sz);
+    if (NULL == store.grow_path) {
+        fprintf(stderr,
+                "Error allocating memory in function 'history_open()' in file '%s' at line '%d'.\nERROR : %s\n",
+                __FILE__, __LINE__, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    snprintf(store.grow_path, grow_sz, "%s.grow", path);
+
+    store.fd = open(path, create ? (O_RDWR | O_CREAT) : O_RDWR, 0600);
+    if (store.fd < 0 && !create && errno == ENOENT) {
+        history_close();
+        return -1;
+    }
+    if (store.fd < 0) {
+        history_fail("open", path);
+    }
+
+    /* hold the lock while checking the file so two new processes do not both initialise it */
+    if (flock(store.fd, LOCK_EX) != 0) {
+        history_fail("lock", path);
+    }
+
+    if (fstat(store.fd, &st) != 0) {
+        history_fail("check", path);
+    }
+
+    memset(&header, 0, sizeof(header));
+    if ((size_t)st.st_size >= sizeof(header) &&
+        pread(store.fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header)) {
+        history_fail("read", path);
+    }
+
+    /* an empty file is a new store - as is a header sized file of zeros, left by a failure while the store was
+     * being created, which is safe to start again as no passwords can have been recorded in it. Any other file
+     * that is not a store is refused below, so a mistyped path never overwrites it. */
+    static const struct history_header zero_header;
+    int is_new = (st.st_size == 0) ||
+                 ((size_t)st.st_size == sizeof(header) && memcmp(&header, &zero_header, sizeof(header)) == 0);
+
+    if (is_new && !create) {
+        history_close();
+        return -1;
+    }
+    if ((size_t)st.st_size < sizeof(header) && !is_new) {
+        errno = EINVAL;
+        history_fail("use", path);
+    }
+
+    if (is_new) {
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, HISTORY_MAGIC, sizeof(header.magic));
+        header.version = HISTORY_VERSION;
+        header.num_slots = HISTORY_INITIAL_SLOTS;
+        fill_key(header.key, sizeof(header.key));
+
+        /* the header is written first, so the file is only ever extended once it is valid */
+        if (ftruncate(store.fd, 0) != 0 ||
+            pwrite(store.fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+            fsync(store.fd) != 0 ||
+            ftruncate(store.fd, (off_t)store_size(header.num_slots)) != 0) {
+            history_fail("initialise", path);
+        }
+    } else if (memcmp(header.magic, HISTORY_MAGIC, sizeof(header.magic)) != 0 ||
+               header.version != HISTORY_VERSION || header.num_slots < HISTORY_INITIAL_SLOTS ||
+               (header.num_slots & (header.num_slots - 1)) != 0) {
+        errno = EINVAL;
+        history_fail("use", path);
+    } else if (!header.growing && (size_t)st.st_size != store_size(header.num_slots)) {
+        /* an empty store whose creation stopped before the file was extended can simply be extended now */
+        if (header.entries != 0 || (size_t)st.st_size > store_size(header.num_slots) ||
+            ftruncate(store.fd, (off_t)store_size(header.num_slots)) != 0) {
+            errno = EINVAL;
+            history_fail("use", path);
+        }
+    }
+
+    if (header.growing) {
+        /* the file may be shorter than the header says until the rebuild is completed */
+        if (ftruncate(store.fd, (off_t)store_size(header.num_slots)) != 0) {
+            history_fail("resize", path);
+        }
+        store_map();
+        store_recover();
+    } else {
+        store_map();
+    }
+
+    flock(store.fd, LOCK_UN);
+    store_enabled = 1;
+    return 0;
+}
+
+/**
+ * @brief Check one password against the store, and record it if not found. The caller holds both locks.
+ * @param password : the password string to check.
+ * @return int : one if the password was already in the history, otherwise zero.
+ */
+static int store_check_and_add(const char *password)
+{
+    uint64_t digest = siphash24(store.header->key, (const unsigned char *)password, strlen(password));
+    /* zero marks an empty hash table slot */
+    if (digest == 0) {
+        digest = 1;
+    }
+
+    int found = store_contains(digest);
+    if (!found) {
+        if ((store.header->entries + 1) * 2 > store.header->num_slots) {
+            store_grow();
+        }
+        store_insert(digest);
+        store.header->entries++;
+    }
+    return found;
+}
+
+/**
+ * @brief Take the thread and file locks on the store, and pick up any change made by another process.
+ * @return int : one if the store is open and locked, or zero if it has been closed - no lock is then held.
+ */
+static int store_lock_all(void)
+{
+    /* the lock is taken before the store is used so `history_close()` cannot unmap it part way through */
+    pthread_mutex_lock(&store_lock);
+    if (NULL == store.header) {
+        pthread_mutex_unlock(&store_lock);
+        return 0;
+    }
+    if (flock(store.fd, LOCK_EX) != 0) {
+        history_fail("lock", store.path);
+    }
+    store_refresh();
+    return 1;
+}
+
+/**
+ * @brief Release the locks taken by `store_lock_all()`.
+ * @return no return
+ */
+static void store_unlock_all(void)
+{
+    flock(store.fd, LOCK_UN);
+    pthread_mutex_unlock(&store_lock);
+}
+
+/**
+ * @brief Check if a password has been issued before, and record it as issued if not.
+ * @param password : the password string to check.
+ * @return int : one if the password was already in the history, otherwise zero. Always zero if no store is open.
+ */
+int history_check_and_add(const char *password)
+{
+    if (!store_enabled || !store_lock_all()) {
+        return 0;
+    }
+    int found = store_check_and_add(password);
+    store_unlock_all();
+    return found;
+}
+
+/**
+ * @brief Check a batch of passwords, recording as issued each one not issued before, with the locks taken once
+ * for the whole batch. A password repeated within the batch is found by its second check.
+ * @param passwords : the password strings to check.
+ * @param count : the number of passwords in the batch.
+ * @param found : set for each password to one if it was already in the history, otherwise zero.
+ * @return int : the number of passwords already in the history. Always zero if no store is open.
+ */
+int history_check_and_add_batch(const char *const *passwords, int count, int *found)
+{
+    int num_found = 0;
+
+    if (!store_enabled || !store_lock_all()) {
+        for (int i = 0; i < count; i++) {
+            found[i] = 0;
+        }
+        return 0;
+    }
+    for (int i = 0; i < count; i++) {
+        found[i] = store_check_and_add(passwords[i]);
+        num_found += found[i];
+    }
+    store_unlock_all();
+    return num_found;
+}
+
+/**
+ * @brief Number of passwords recorded in the open history store.
+ * @return long : the count of passwords, or minus one (-1) if no store is open.
+ */
+long history_entries(void)
+{
+    pthread_mutex_lock(&store_lock);
+    long entries = (NULL == store.header) ? -1 : (long)store.header->entries;
+    pthread_mutex_unlock(&store_lock);
+    return entries;
+}
+
+/**
+ * @brief Flush and close the open history store, if any, unless a thread is still using it.
+ * @return no return
+ */
+void history_close(void)
+{
+    /* the store is still in use if the lock is held - either by another thread, or by this thread exiting via
+     * `history_fail()`. It is left mapped so the holder is not disturbed, and released as the process exits. */
+    if (pthread_mutex_trylock(&store_lock) != 0) {
+        return;
+    }
+    store_enabled = 0;
+    if (NULL != store.header) {
+        msync(store.header, store.map_size, MS_ASYNC);
+        munmap(store.header, store.map_size);
+        store.header = NULL;
+        store.blocks = NULL;
+        store.slots = NULL;
+    }
+    if (store.fd >= 0) {
+        close(store.fd);
+        store.fd = -1;
+    }
+    free(store.grow_path);
+    store.grow_path = NULL;
+    store.path = NULL;
+    pthread_mutex_unlock(&store_lock);
+}
+
+#endif
@@ -0,0 +1,34 @@
+/**
+ * @file history.h
+ * @brief Offer Password (opass): persistent cross-run history of issued passwords, used to ensure the
+ * same password is never offered twice.
+ *
+ * @author:     simon rowe <simon@wiremoons.com>
+ * @license:    open-source released under "MIT License"
+ * @source:     https://github.com/wiremoons/opass
+ *
+ * @date originally created: 18 Oct 2026
+ *
+ * The program is licensed under the "*MIT License*" see
+ * http://opensource.org/licenses/MIT for more details.
+ *
+ */
+
+#ifndef OPASS_HISTORY_H
+#define OPASS_HISTORY_H
+
+/** @note number of hash table slots in a new history store - doubled each time the table is half full */
+#define HISTORY_INITIAL_SLOTS 131072
+/** @note number of hash table slots for each 64 byte Bloom filter block - 16 filter bits per password held */
+#define HISTORY_SLOTS_PER_BLOCK 64
+/** @note number of times a new password is generated when a candidate is found in the history */
+#define HISTORY_MAX_ATTEMPTS 1000
+
+int history_open(const char *path, int create);
+int history_check_and_add(const char *password);
+int history_check_and_add_batch(const char *const *passwords, int count, int *found);
+long history_entries(void);
+void history_close(void);
+
+
+#endif //OPASS_HISTORY_H
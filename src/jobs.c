@@ -0,0 +1,601 @@
+/*
+ * Offer Password (opass): jobs.c
+ *
+ * Batch runner, run via command line option '--jobs <manifest>'. See: https://github.com/wiremoons/opass
+ *
+ * The manifest is a tab separated text file with one job per line. Blank lines and lines starting with '#'
+ * are ignored. The columns are:
+ *
+ *   name     a label for the job, used in the timing summary              (required)
+ *   words    number of three letter words - 1 to 50                        (empty: OPASS_WORDS or 3)
+ *   count    number of passwords to generate                               (required)
+ *   format   plain, spaced, full or capitalised                            (empty: plain)
+ *   output   file the passwords are written to, one per line - or '-'      (empty: stdout)
+ *
+ * Every job is loaded before any work starts, then split into chunks of `JOBS_CHUNK_SIZE` passwords. The chunks
+ * of each job are queued on one worker thread, and a worker that runs out of its own chunks steals from the
+ * others, so a mix of a few large jobs and many small ones still keeps every thread busy. Jobs writing to the
+ * same output share it. A timing summary for each job is written to stderr once all jobs are complete.
+ *
+ * If a job can not generate a password that is not already in the history store, its worker writes the passwords
+ * generated so far and stops the pool. No further chunks are started, and `run_jobs()` reports the failure once
+ * every worker has finished, so the outputs hold every password recorded as issued.
+ *
+ * MIT License
+ *
+ */
+
+#define _DEFAULT_SOURCE
+
+#include "jobs.h"
+#include "format.h"
+#include "password.h"
+#include "history.h"
+
+#include <stdio.h>    /* fopen, fgets, fwrite, fprintf */
+#include <stdlib.h>   /* malloc, realloc, strtol, getenv */
+#include <string.h>   /* strchr, strcmp, strlen */
+#include <errno.h>    /* strerror */
+#include <time.h>     /* timespec_get */
+#include <unistd.h>   /* sysconf */
+#include <pthread.h>  /* pthread_create, pthread_mutex_lock */
+
+/**
+ *  `struct job_output` : a file that one or more jobs write their passwords to.
+ */
+struct job_output {
+    char *path;
+    FILE *file;
+    pthread_mutex_t lock;
+};
+
+/**
+ *  `struct job` : one line of the manifest, and the timings collected while its chunks are run.
+ */
+struct job {
+    char *name;
+    int words;
+    int count;
+    enum password_format format;
+    const char *format_name;
+    struct job_output *output;
+    pthread_mutex_t lock;
+    int chunks;
+    long written;
+    double start;
+    double end;
+    double busy;
+};
+
+/**
+ *  `struct chunk` : a unit of work - up to `JOBS_CHUNK_SIZE` passwords for one job.
+ */
+struct chunk {
+    struct job *job;
+    int count;
+};
+
+/**
+ *  `struct worker` : a thread and its queue of chunks. The owner takes chunks from the tail of its own queue,
+ *  while other workers steal from the head.
+ */
+struct worker {
+    pthread_t thread;
+    int id;
+    pthread_mutex_t lock;
+    struct chunk *chunks;
+    size_t head;
+    size_t tail;
+    long completed;
+    long stolen;
+};
+
+/** @var the worker pool and the settings shared by every worker */
+static struct {
+    struct worker *workers;
+    int num_workers;
+    int wordArraySize;
+    int marksArraySize;
+    pthread_mutex_t lock;
+    struct job *failed;
+} pool;
+
+/**
+ * @brief The current time in seconds, used to time the jobs.
+ * @return double : seconds since the Epoch.
+ */
+static double now_seconds(void)
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (double)ts.tv_sec + ((double)ts.tv_nsec / 1e9);
+}
+
+/**
+ * @brief Report a memory allocation failure and exit the program.
+ * @param function : the name of the function where the allocation failed.
+ * @return no return
+ */
+static void jobs_alloc_fail(const char *function)
+{
+    fprintf(stderr, "Error allocating memory in function '%s()' in file '%s'.\nERROR : %s\n",
+            function, __FILE__, strerror(errno));
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * @brief Report a problem with a manifest line and exit the program.
+ * @param path : the manifest file.
+ * @param line : the line number of the problem.
+ * @param message : description of the problem.
+ * @return no return
+ */
+static void manifest_fail(const char *path, int line, const char *message)
+{
+    fprintf(stderr, "Error in job manifest '%s' at line '%d': %s\n", path, line, message);
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * @brief Copy a string to new heap memory.
+ * @param str : the string to copy.
+ * @return a pointer to the heap allocated copy.
+ */
+static char *copy_str(const char *str)
+{
+    size_t size = strlen(str) + 1;
+    char *copy = malloc(size);
+    if (NULL == copy) {
+        jobs_alloc_fail("copy_str");
+    }
+    memcpy(copy, str, size);
+    return copy;
+}
+
+/**
+ * @brief Find the output already used by an earlier job for `path`, or add a new one.
+ * @param outputs : the array of outputs - may be moved by `realloc()`.
+ * @param num_outputs : the number of outputs in the array - increased if one is added.
+ * @param path : the file name, or '-' for stdout.
+ * @return the index of the output in the array.
+ */
+static int find_output(struct job_output **outputs, int *num_outputs, const char *path)
+{
+    for (int i = 0; i < *num_outputs; i++) {
+        if (strcmp((*outputs)[i].path, path) == 0) {
+            return i;
+        }
+    }
+
+    struct job_output *grown = realloc(*outputs, sizeof(struct job_output) * (size_t)(*num_outputs + 1));
+    if (NULL == grown) {
+        jobs_alloc_fail("find_output");
+    }
+    *outputs = grown;
+    (*outputs)[*num_outputs].path = copy_str(path);
+    (*outputs)[*num_outputs].file = NULL;
+    return (*num_outputs)++;
+}
+
+/**
+ * @brief Read every job from the manifest file.
+ * @param path : the manifest file.
+ * @param wordsRequired : the number of three letter words used when a job does not give one.
+ * @param jobs : set to the heap allocated array of jobs.
+ * @param outputs : set to the heap allocated array of outputs used by the jobs.
+ * @param num_outputs : set to the number of outputs.
+ * @return int : the number of jobs loaded. Any problem with the manifest is reported and the program exits.
+ */
+static int load_manifest(const char *path, int wordsRequired, struct job **jobs, struct job_output **outputs,
+                         int *num_outputs)
+{
+    FILE *manifest = fopen(path, "r");
+    char line[JOBS_MAX_LINE];
+    int line_num = 0;
+    int num_jobs = 0;
+    /* outputs are found by index while loading as the array may move - converted to pointers at the end */
+    int *output_index = NULL;
+
+    if (NULL == manifest) {
+        fprintf(stderr, "Error: unable to open job manifest '%s'.\nERROR : %s\n", path, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    *jobs = NULL;
+    *outputs = NULL;
+    *num_outputs = 0;
+
+    while (fgets(line, sizeof(line), manifest) != NULL) {
+        line_num++;
+
+        if (NULL == strchr(line, '\n') && !feof(manifest)) {
+            manifest_fail(path, line_num, "line is too long");
+        }
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0' || line[0] == '#') {
+            continue;
+        }
+
+        /* split on tabs - empty columns are kept so later columns stay in place */
+        char *fields[5] = {"", "", "", "", ""};
+        int num_fields = 0;
+        char *field = line;
+        for (;;) {
+            fields[num_fields++] = field;
+            char *tab = strchr(field, '\t');
+            if (NULL == tab || num_fields == 5) {
+                break;
+            }
+            *tab = '\0';
+            field = tab + 1;
+        }
+        if (num_fields == 5 && NULL != strchr(fields[4], '\t')) {
+            manifest_fail(path, line_num, "more than five columns - use: name, words, count, format, output");
+        }
+
+        struct job job;
+        memset(&job, 0, sizeof(job));
+        char *end = NULL;
+
+        if (fields[0][0] == '\0') {
+            manifest_fail(path, line_num, "the job name column is empty");
+        }
+
+        job.words = wordsRequired;
+        if (fields[1][0] != '\0') {
+            long words = strtol(fields[1], &end, 10);
+            if (*end != '\0' || words < 1 || words > 50) {
+                manifest_fail(path, line_num, "words must be a number from 1 to 50");
+            }
+            job.words = (int)words;
+        }
+
+        long count = strtol(fields[2], &end, 10);
+        if (end == fields[2] || *end != '\0' || count < 1 || count > JOBS_MAX_COUNT) {
+            manifest_fail(path, line_num, "count must be a number from 1 to 10000000");
+        }
+        job.count = (int)count;
+
+        job.format = FORMAT_PLAIN;
+        if (fields[3][0] != '\0') {
+            if (format_from_name(fields[3], &job.format) != 0) {
+                manifest_fail(path, line_num, "format must be one of: plain spaced full capitalised");
+            }
+        }
+
+        struct job *grown = realloc(*jobs, sizeof(struct job) * (size_t)(num_jobs + 1));
+        int *grown_index = realloc(output_index, sizeof(int) * (size_t)(num_jobs + 1));
+        if (NULL == grown || NULL == grown_index) {
+            jobs_alloc_fail("load_manifest");
+        }
+        *jobs = grown;
+        output_index = grown_index;
+
+        job.name = copy_str(fields[0]);
+        job.format_name = copy_str(fields[3][0] != '\0' ? fields[3] : "plain");
+        output_index[num_jobs] = find_output(outputs, num_outputs, fields[4][0] != '\0' ? fields[4] : "-");
+        (*jobs)[num_jobs++] = job;
+    }
+    fclose(manifest);
+
+    for (int i = 0; i < num_jobs; i++) {
+        (*jobs)[i].output = &(*outputs)[output_index[i]];
+    }
+    free(output_index);
+    return num_jobs;
+}
+
+/**
+ * @brief Take a chunk from the tail of the workers own queue.
+ * @param worker : the worker owning the queue.
+ * @param chunk : set to the chunk taken.
+ * @return int : one if a chunk was taken, or zero if the queue is empty.
+ */
+static int worker_pop(struct worker *worker, struct chunk *chunk)
+{
+    int found = 0;
+
+    pthread_mutex_lock(&worker->lock);
+    if (worker->tail > worker->head) {
+        *chunk = worker->chunks[--worker->tail];
+        found = 1;
+    }
+    pthread_mutex_unlock(&worker->lock);
+    return found;
+}
+
+/**
+ * @brief Steal a chunk from the head of another workers queue - the chunk queued longest ago.
+ * @param victim : the worker to steal from.
+ * @param chunk : set to the chunk taken.
+ * @return int : one if a chunk was taken, or zero if the queue is empty.
+ */
+static int worker_steal(struct worker *victim, struct chunk *chunk)
+{
+    int found = 0;
+
+    pthread_mutex_lock(&victim->lock);
+    if (victim->tail > victim->head) {
+        *chunk = victim->chunks[victim->head++];
+        found = 1;
+    }
+    pthread_mutex_unlock(&victim->lock);
+    return found;
+}
+
+/**
+ * @brief Check if a job has failed, so no further chunks should be started.
+ * @return int : one if the pool is stopping, otherwise zero.
+ */
+static int pool_stopping(void)
+{
+    pthread_mutex_lock(&pool.lock);
+    int stopping = (NULL != pool.failed);
+    pthread_mutex_unlock(&pool.lock);
+    return stopping;
+}
+
+/**
+ * @brief Generate the passwords for one chunk, write them to the jobs output, and record the time taken.
+ * @param chunk : the chunk to run.
+ * @param buf : buffer for the passwords - must hold `JOBS_CHUNK_SIZE * FORMAT_MAX_LEN` chars.
+ * @return int : zero on success, or minus one (-1) if the history store had no new password left for the job. Any
+ * passwords generated before the failure are still written.
+ */
+static int run_chunk(const struct chunk *chunk, char *buf)
+{
+    struct job *job = chunk->job;
+    double start = now_seconds();
+    int written = 0;
+    size_t used = get_formatted_passwords(job->format, job->words, pool.wordArraySize, pool.marksArraySize,
+                                          chunk->count, buf, &written);
+
+    if (written < chunk->count) {
+        pthread_mutex_lock(&pool.lock);
+        if (NULL == pool.failed) {
+            pool.failed = job;
+        }
+        pthread_mutex_unlock(&pool.lock);
+    }
+
+    pthread_mutex_lock(&job->output->lock);
+    fwrite(buf, 1, used, job->output->file);
+    pthread_mutex_unlock(&job->output->lock);
+
+    double end = now_seconds();
+
+    pthread_mutex_lock(&job->lock);
+    if (job->start == 0.0 || start < job->start) {
+        job->start = start;
+    }
+    if (end > job->end) {
+        job->end = end;
+    }
+    job->busy += end - start;
+    job->written += written;
+    pthread_mutex_unlock(&job->lock);
+
+    return (written == chunk->count) ? 0 : -1;
+}
+
+/**
+ * @brief Worker thread: run chunks from its own queue, then steal from the other workers until no work is left, or
+ * a job fails.
+ * @param arg : the `struct worker` for this thread.
+ * @return always NULL.
+ */
+static void *worker_main(void *arg)
+{
+    struct worker *self = arg;
+    struct chunk chunk;
+    char *buf = malloc((size_t)JOBS_CHUNK_SIZE * FORMAT_MAX_LEN);
+
+    if (NULL == buf) {
+        jobs_alloc_fail("worker_main");
+    }
+
+    while (!pool_stopping()) {
+        if (worker_pop(self, &chunk)) {
+            if (run_chunk(&chunk, buf) != 0) {
+                break;
+            }
+            self->completed++;
+            continue;
+        }
+
+        /* own queue is empty - no new chunks are ever queued, so if every other queue is empty too all work
+         * has been taken and the worker is finished */
+        int found = 0;
+        for (int i = 1; i < pool.num_workers && !found; i++) {
+            found = worker_steal(&pool.workers[(self->id + i) % pool.num_workers], &chunk);
+        }
+        if (!found || run_chunk(&chunk, buf) != 0) {
+            break;
+        }
+        self->completed++;
+        self->stolen++;
+    }
+
+    free(buf);
+    return NULL;
+}
+
+/**
+ * @brief Set the number of worker threads to use.
+ * @param OPASS_THREADS : obtained from user set environment variable, otherwise the number of online CPUs.
+ * @param total_chunks : the number of chunks to be run - no more threads than this are used.
+ * @return int : number of worker threads.
+ */
+static int set_number_threads(int total_chunks)
+{
+    long result = getenv("OPASS_THREADS") ? atol(getenv("OPASS_THREADS")) : 0;
+
+    #ifdef _SC_NPROCESSORS_ONLN
+    if (result < 1) {
+        result = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    #endif
+    if (result < 1) {
+        result = 1;
+    }
+    if (result > JOBS_MAX_THREADS) {
+        result = JOBS_MAX_THREADS;
+    }
+    if (result > total_chunks) {
+        result = total_chunks;
+    }
+    return (int)result;
+}
+
+/**
+ * @brief Run every job in a manifest file, then output a timing summary for each job to stderr.
+ * @param manifest_path : the tab separated job manifest file.
+ * @param wordsRequired : the number of three letter words used when a job does not give one.
+ * @param wordArraySize : the size of the `char const *words[]` array.
+ * @param marksArraySize : the size of the `int const marks[]` array.
+ * @return int : `EXIT_SUCCESS`, or `EXIT_FAILURE` if a job could not be completed or an output could not be written.
+ */
+int run_jobs(const char *manifest_path, int wordsRequired, int wordArraySize, int marksArraySize)
+{
+    struct job *jobs = NULL;
+    struct job_output *outputs = NULL;
+    int num_outputs = 0;
+    int num_jobs = load_manifest(manifest_path, wordsRequired, &jobs, &outputs, &num_outputs);
+    int total_chunks = 0;
+    long total_passwords = 0;
+    int result = EXIT_SUCCESS;
+
+    if (num_jobs == 0) {
+        fprintf(stderr, "Error: no jobs found in job manifest '%s'.\n", manifest_path);
+        return EXIT_FAILURE;
+    }
+
+    set_history_store();
+
+    for (int i = 0; i < num_outputs; i++) {
+        outputs[i].file = (strcmp(outputs[i].path, "-") == 0) ? stdout : fopen(outputs[i].path, "w");
+        if (NULL == outputs[i].file) {
+            fprintf(stderr, "Error: unable to open job output '%s'.\nERROR : %s\n", outputs[i].path, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        pthread_mutex_init(&outputs[i].lock, NULL);
+    }
+
+    for (int i = 0; i < num_jobs; i++) {
+        jobs[i].chunks = (jobs[i].count + JOBS_CHUNK_SIZE - 1) / JOBS_CHUNK_SIZE;
+        pthread_mutex_init(&jobs[i].lock, NULL);
+        total_chunks += jobs[i].chunks;
+        total_passwords += jobs[i].count;
+    }
+
+    pool.wordArraySize = wordArraySize;
+    pool.marksArraySize = marksArraySize;
+    pool.failed = NULL;
+    pthread_mutex_init(&pool.lock, NULL);
+    pool.num_workers = set_number_threads(total_chunks);
+    pool.workers = calloc((size_t)pool.num_workers, sizeof(struct worker));
+    if (NULL == pool.workers) {
+        jobs_alloc_fail("run_jobs");
+    }
+
+    /* size each workers queue, then queue every chunk of a job on the same worker - job `i` goes to worker
+     * `i % num_workers`. Stealing evens out the work where jobs are of very different sizes. */
+    for (int i = 0; i < num_jobs; i++) {
+        pool.workers[i % pool.num_workers].tail += (size_t)jobs[i].chunks;
+    }
+    for (int w = 0; w < pool.num_workers; w++) {
+        pool.workers[w].id = w;
+        pool.workers[w].chunks = malloc(sizeof(struct chunk) * (pool.workers[w].tail + 1));
+        if (NULL == pool.workers[w].chunks) {
+            jobs_alloc_fail("run_jobs");
+        }
+        pool.workers[w].tail = 0;
+        pthread_mutex_init(&pool.workers[w].lock, NULL);
+    }
+    for (int i = 0; i < num_jobs; i++) {
+        struct worker *worker = &pool.workers[i % pool.num_workers];
+        for (int left = jobs[i].count; left > 0; left -= JOBS_CHUNK_SIZE) {
+            worker->chunks[worker->tail].job = &jobs[i];
+            worker->chunks[worker->tail].count = left < JOBS_CHUNK_SIZE ? left : JOBS_CHUNK_SIZE;
+            worker->tail++;
+        }
+    }
+
+    double start = now_seconds();
+
+    for (int w = 0; w < pool.num_workers; w++) {
+        if (pthread_create(&pool.workers[w].thread, NULL, worker_main, &pool.workers[w]) != 0) {
+            fprintf(stderr, "Error: unable to start worker thread '%d' in file '%s' at line '%d'.\n",
+                    w, __FILE__, __LINE__);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    long completed = 0;
+    long stolen = 0;
+    for (int w = 0; w < pool.num_workers; w++) {
+        pthread_join(pool.workers[w].thread, NULL);
+        completed += pool.workers[w].completed;
+        stolen += pool.workers[w].stolen;
+    }
+    long written = 0;
+    for (int i = 0; i < num_jobs; i++) {
+        written += jobs[i].written;
+    }
+
+    double elapsed = now_seconds() - start;
+
+    for (int i = 0; i < num_outputs; i++) {
+        if (fflush(outputs[i].file) != 0 || ferror(outputs[i].file)) {
+            fprintf(stderr, "Error: unable to write job output '%s'.\nERROR : %s\n", outputs[i].path, strerror(errno));
+            result = EXIT_FAILURE;
+        }
+        if (outputs[i].file != stdout) {
+            fclose(outputs[i].file);
+        }
+    }
+
+    if (NULL != pool.failed) {
+        fprintf(stderr,
+                "Error: job '%s' stopped as a password not already in the history store could not be generated after"
+                " '%d' attempts.\nIncrease the 'words' column for the job in manifest '%s'. '%ld' of '%ld' passwords"
+                " were written.\n",
+                pool.failed->name, HISTORY_MAX_ATTEMPTS, manifest_path, written, total_passwords);
+        result = EXIT_FAILURE;
+    }
+
+    /* timing summary for each job: 'time' is from its first chunk starting to its last chunk finishing, and
+     * 'busy' is the total time spent by all workers on its chunks */
+    fprintf(stderr, "\nJob summary: '%d' jobs, '%ld' passwords, '%d' threads, '%ld' of '%d' chunks completed ('%ld' stolen)"
+            " in %.3f seconds.\n\n",
+            num_jobs, written, pool.num_workers, completed, total_chunks, stolen, elapsed);
+    fprintf(stderr, "  %-20s %5s %9s  %-12s %-20s %10s %10s %13s\n",
+            "job", "words", "count", "format", "output", "time (ms)", "busy (ms)", "passwords/s");
+    for (int i = 0; i < num_jobs; i++) {
+        double job_time = jobs[i].end - jobs[i].start;
+        fprintf(stderr, "  %-20.20s %5d %9ld  %-12.12s %-20.20s %10.3f %10.3f %13.0f\n",
+                jobs[i].name, jobs[i].words, jobs[i].written, jobs[i].format_name, jobs[i].output->path,
+                job_time * 1000.0, jobs[i].busy * 1000.0, job_time > 0.0 ? jobs[i].written / job_time : 0.0);
+    }
+    fprintf(stderr, "\n");
+
+    for (int w = 0; w < pool.num_workers; w++) {
+        pthread_mutex_destroy(&pool.workers[w].lock);
+        free(pool.workers[w].chunks);
+    }
+    free(pool.workers);
+    pool.workers = NULL;
+    pthread_mutex_destroy(&pool.lock);
+    for (int i = 0; i < num_jobs; i++) {
+        pthread_mutex_destroy(&jobs[i].lock);
+        free(jobs[i].name);
+        free((char *)jobs[i].format_name);
+    }
+    free(jobs);
+    for (int i = 0; i < num_outputs; i++) {
+        pthread_mutex_destroy(&outputs[i].lock);
+        free(outputs[i].path);
+    }
+    free(outputs);
+
+    return result;
+}
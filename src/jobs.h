@@ -0,0 +1,32 @@
+/**
+ * @file jobs.h
+ * @brief Offer Password (opass): batch runner - generates the passwords for every job listed in a manifest
+ * file using a pool of worker threads.
+ *
+ * @author:     simon rowe <simon@wiremoons.com>
+ * @license:    open-source released under "MIT License"
+ * @source:     https://github.com/wiremoons/opass
+ *
+ * @date originally created: 18 Oct 2026
+ *
+ * The program is licensed under the "*MIT License*" see
+ * http://opensource.org/licenses/MIT for more details.
+ *
+ */
+
+#ifndef OPASS_JOBS_H
+#define OPASS_JOBS_H
+
+/** @note number of passwords generated as one unit of work by a worker thread */
+#define JOBS_CHUNK_SIZE 256
+/** @note largest number of passwords one job can ask for */
+#define JOBS_MAX_COUNT 10000000
+/** @note largest number of worker threads - see `OPASS_THREADS` */
+#define JOBS_MAX_THREADS 256
+/** @note longest manifest line accepted, including the newline */
+#define JOBS_MAX_LINE 1024
+
+int run_jobs(const char *manifest_path, int wordsRequired, int wordArraySize, int marksArraySize);
+
+
+#endif //OPASS_JOBS_H
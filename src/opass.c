@@ -10,12 +10,15 @@
  */
 
 #include "opass.h"
+#include "history.h"
+#include "rng.h"
+#include "coproc.h"
+#include "jobs.h"
 
-#include <stdlib.h> /* malloc, srandom, random, env */
+#include <stdlib.h> /* malloc, env */
 #include <ctype.h>  /* isdigit */
 #include <stdio.h>  /* printf, fprintf */
 #include <string.h> /* strncat */
-#include <time.h>   /* time */
 #include <assert.h> /* assert macro */
 #include <errno.h>  /* strerror - see function ‘with_spaces’ */
 
@@ -51,10 +54,89 @@ int set_number_words(void)
     return result;
 }
 
+/**
+ * @brief Writes a string created from randomly selected three (3) letter words from the `const char *words[]` array
+ * to a caller provided buffer, without checking the password history store.
+ * @param wordsRequired : the number of random words to obtain from the `char const *words[]` array.
+ * @param wordArraySize : the size of the `char const *words[]` array.
+ * @param out : buffer for the password - must hold three (3) chars for each word plus one (1) for the `\0`.
+ * @return size_t : the length of the password, not including the `\0`.
+ */
+static size_t random_words_into(int wordsRequired, int wordArraySize, char *out)
+{
+    size_t length = 0;
+
+    for (int x = 1; x <= wordsRequired; x++) {
+        /* get a random number constrained by the size of the word array */
+        long r = (long)(rng_next() % wordArraySize);
+        #if DEBUG
+        printf("DEBUG: word array random number: %ld\n",r);
+        #endif
+        /* every word is three letters long so is copied directly to the end of the password */
+        memcpy(out + length, *(words + r), 3);
+        length += 3;
+    }
+    out[length] = '\0';
+    return length;
+}
+
+/**
+ * @brief Writes a string created from randomly selected three (3) letter words from the `const char *words[]` array
+ * to a caller provided buffer.
+ * @param wordsRequired : the number of random words to obtain from the `char const *words[]` array.
+ * @param wordArraySize : the size of the `char const *words[]` array.
+ * @param out : buffer for the password - must hold three (3) chars for each word plus one (1) for the `\0`.
+ * @return size_t : the length of the password, not including the `\0`. Zero if no password could be found that is
+ * not already in the history store after `HISTORY_MAX_ATTEMPTS` attempts.
+ */
+static size_t random_password_into(int wordsRequired, int wordArraySize, char *out)
+{
+    size_t length;
+    /** @note keep generating passwords until one is found that has not been issued before. Always the first
+     * attempt unless a password history store was requested via the `OPASS_HISTORY` environment variable. */
+    int attempts = 0;
+    do {
+        if (++attempts > HISTORY_MAX_ATTEMPTS) {
+            /* the caller reports this, as only it knows how the user sets the number of words */
+            out[0] = '\0';
+            return 0;
+        }
+        length = random_words_into(wordsRequired, wordArraySize, out);
+    } while (history_check_and_add(out));
+
+    return length;
+}
+
+/**
+ * @brief Writes the provided password words followed by a random mark and a random two digit number to a
+ * caller provided buffer.
+ * @param str_password : the baseline string of three letter words to be used.
+ * @param length : the length of `str_password`.
+ * @param marksArraySize : the size of the `int const marks[]` array.
+ * @param out : buffer for the full password - must hold `length` plus four (4) chars.
+ * @return size_t : the length of the full password, not including the `\0`.
+ */
+static size_t full_password_into(const char *str_password, size_t length, int marksArraySize, char *out)
+{
+    /** @note Create the full password with component parts. The number is between 0 and 98, so is written
+     * as the same two digits the `%02d` format gives in `get_full_password_str()` without calling `snprintf()`. */
+    int mark = marks[(rng_next() % marksArraySize)];
+    int number = (int)(rng_next() % 99);
+
+    memmove(out, str_password, length);
+    out[length] = (char)mark;
+    out[length + 1] = (char)('0' + number / 10);
+    out[length + 2] = (char)('0' + number % 10);
+    out[length + 3] = '\0';
+
+    return length + 3;
+}
+
 /**
  * @brief Gets a string created from randomly selected three (3) letter words from the `const char *words[]` array.
  * @param wordsRequired : the number of random words to obtain from the `char const *words[]` array.
- * @return a pointer to the heap allocated string of three (3) letter words randomly generated.
+ * @return a pointer to the heap allocated string of three (3) letter words randomly generated, or NULL if no
+ * password could be found that is not already in the history store.
  */
 char *get_random_password_str(int wordsRequired, int wordArraySize)
 {
@@ -70,24 +152,171 @@ char *get_random_password_str(int wordsRequired, int wordArraySize)
                 __FILE__, __LINE__, strerror(errno));
         exit(EXIT_FAILURE);
     }
-    /** @note initialise newly allocated memory with the C string termination character `\0` so works with `strncat` */
-    *generated_password = '\0';
-
-    for (int x = 1; x <= wordsRequired; x++) {
-        /* get a random number constrained by the size of the word array */
-        long r = (random() % wordArraySize);
-        #if DEBUG
-        printf("DEBUG: word array random number: %ld\n",r);
-        #endif
-        /* add the new word to the 'generated_password' variable we allocated on
-         * heap earlier
-         */
-        strncat(generated_password, *(words + r), strlen(*(words + r)));
+    if (random_password_into(wordsRequired, wordArraySize, generated_password) == 0) {
+        free(generated_password);
+        return NULL;
     }
     /* return the heap memory address of variable: char *generated_password */
     return generated_password;
 }
 
+/**
+ * @brief Gets a string made up from the provided password words followed by a random mark and a random two digit number.
+ * @param str_password : the baseline string of three letter words to be used.
+ * @param marksArraySize : the size of the `int const marks[]` array.
+ * @return a pointer to the heap allocated full password string.
+ */
+char *get_full_password_str(const char *str_password, int marksArraySize)
+{
+    /* size_t == length of 'str_password' + mark + random number */
+    size_t fullpass_sz = ( (sizeof(char) * strlen(str_password)) + (sizeof(char)) + (sizeof(char) *2 ) + 1);
+
+    #if DEBUG
+    printf("DEBUG: '*fullpass' length: %d\n",(int)fullpass_sz);
+    #endif
+
+    char *fullpass = malloc(fullpass_sz);
+
+    if (NULL == fullpass) {
+        fprintf(stderr,
+                "Error allocating memory in function 'get_full_password_str()' in file '%s' at line '%d'.\nERROR : %s\n",
+                __FILE__, __LINE__, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    /** @note Create a `*fullpass` with component parts. The mark is drawn before the number, the same order as
+     * `full_password_into()`, so both give the same password from the same random numbers.
+     * The call to `rng_next()` is cast as `int` for use with the `%02d` format. As only random
+     * numbers between 0 and 99 are being used, limiting the returned value to `int` is safe. */
+    int mark = marks[(rng_next() % marksArraySize)];
+    int number = (int)(rng_next() % 99);
+    snprintf(fullpass,fullpass_sz,"%s%c%02d",str_password,mark,number);
+
+    return fullpass;
+}
+
+/**
+ * @brief Writes a password of three letter words in the requested output style.
+ * @param format : the output style of the password.
+ * @param newpass : the password of three letter words.
+ * @param length : the length of `newpass`.
+ * @param marksArraySize : the size of the `int const marks[]` array.
+ * @param out : buffer for the password - must hold `FORMAT_MAX_LEN` chars.
+ * @return size_t : the length of the formatted password, not including the `\0`.
+ */
+static size_t format_password_into(enum password_format format, const char *newpass, size_t length,
+                                   int marksArraySize, char *out)
+{
+    if (format == FORMAT_PLAIN) {
+        memcpy(out, newpass, length + 1);
+    } else if (format == FORMAT_SPACED) {
+        length = format_spaced(newpass, length, out);
+    } else {
+        length = full_password_into(newpass, length, marksArraySize, out);
+        if (format == FORMAT_CAPITALISED) {
+            format_capitalised(out, length);
+        }
+    }
+    return length;
+}
+
+/**
+ * @brief Generates a new password in the requested output style, written to a caller provided buffer.
+ * @details No heap memory is used, so the coprocess and batch modes can call this for every password.
+ * @param format : the output style of the password.
+ * @param wordsRequired : the number of three letter words to include.
+ * @param wordArraySize : the size of the `char const *words[]` array.
+ * @param marksArraySize : the size of the `int const marks[]` array.
+ * @param out : buffer for the password - must hold `FORMAT_MAX_LEN` chars. One spare char is always left after
+ * the password so a caller can append a newline.
+ * @return size_t : the length of the password, not including the `\0`. Zero if no password could be found that is
+ * not already in the history store.
+ */
+size_t get_formatted_password(enum password_format format, int wordsRequired, int wordArraySize, int marksArraySize,
+                              char *out)
+{
+    char newpass[FORMAT_MAX_LEN];
+    size_t length = random_password_into(wordsRequired, wordArraySize, newpass);
+
+    if (length == 0) {
+        out[0] = '\0';
+        return 0;
+    }
+    return format_password_into(format, newpass, length, marksArraySize, out);
+}
+
+/**
+ * @brief Generates many new passwords in the requested output style, each followed by a newline, written to a
+ * caller provided buffer. The password history store is checked for `PASSWORD_BATCH_SIZE` passwords at a time,
+ * so threads sharing the store take its locks once per batch rather than once per password.
+ * @param format : the output style of the passwords.
+ * @param wordsRequired : the number of three letter words to include in each password.
+ * @param wordArraySize : the size of the `char const *words[]` array.
+ * @param marksArraySize : the size of the `int const marks[]` array.
+ * @param count : the number of passwords to generate.
+ * @param out : buffer for the passwords - must hold `count * FORMAT_MAX_LEN` chars.
+ * @param written : set to the number of passwords written. Less than `count` if a password could not be found
+ * that is not already in the history store - every password recorded as issued is still written.
+ * @return size_t : the number of chars written to `out`, with no `\0` added.
+ */
+size_t get_formatted_passwords(enum password_format format, int wordsRequired, int wordArraySize, int marksArraySize,
+                               int count, char *out, int *written)
+{
+    char newpass[PASSWORD_BATCH_SIZE][FORMAT_MAX_LEN];
+    size_t length[PASSWORD_BATCH_SIZE];
+    const char *pending[PASSWORD_BATCH_SIZE];
+    int pending_index[PASSWORD_BATCH_SIZE];
+    int found[PASSWORD_BATCH_SIZE];
+    size_t used = 0;
+
+    *written = 0;
+    for (int done = 0; done < count; done += PASSWORD_BATCH_SIZE) {
+        int batch = (count - done < PASSWORD_BATCH_SIZE) ? (count - done) : PASSWORD_BATCH_SIZE;
+        int num_pending = batch;
+
+        for (int i = 0; i < batch; i++) {
+            length[i] = random_words_into(wordsRequired, wordArraySize, newpass[i]);
+            pending_index[i] = i;
+        }
+
+        /** @note as `random_password_into()`, a password already issued is generated again until a new one is
+         * found - here every password still pending in the batch is checked together. */
+        int attempts = 0;
+        while (num_pending > 0 && ++attempts <= HISTORY_MAX_ATTEMPTS) {
+            for (int p = 0; p < num_pending; p++) {
+                pending[p] = newpass[pending_index[p]];
+            }
+            history_check_and_add_batch(pending, num_pending, found);
+
+            int left = 0;
+            for (int p = 0; p < num_pending; p++) {
+                if (found[p]) {
+                    int i = pending_index[p];
+                    length[i] = random_words_into(wordsRequired, wordArraySize, newpass[i]);
+                    pending_index[left++] = i;
+                }
+            }
+            num_pending = left;
+        }
+        /* any still pending were never recorded as issued, so are left out */
+        for (int p = 0; p < num_pending; p++) {
+            length[pending_index[p]] = 0;
+        }
+
+        for (int i = 0; i < batch; i++) {
+            if (length[i] == 0) {
+                continue;
+            }
+            used += format_password_into(format, newpass[i], length[i], marksArraySize, out + used);
+            out[used++] = '\n';
+            (*written)++;
+        }
+        if (num_pending > 0) {
+            break;
+        }
+    }
+    return used;
+}
+
 /**
  * @brief Created a new string and adds a spaces at every third character position. New string is then output and freed.
  * @param str_password : the baseline string to be used - copied in memory to a new string that has added spaces.
@@ -99,11 +328,11 @@ void with_spaces(char *str_password)
      * @note Get heap memory for a new string to contain the existing password `*str_password` plus the spaces needed.
      * All words in the password string are three (3) characters in length - so divide password length by three (3).
      * Result will give number of spaces required. No additional space is added to the end of the password string by
-     * this function - so the one extra space that results in the new string length calculation will be used for the
-     * C string termination character `\0` instead.
+     * this function, but a string whose length is not a multiple of three (3) still has a space after its last whole
+     * word - so plus one (1) is always added for the C string termination character `\0`.
      */
     size_t length = (strlen(str_password) + (strlen(str_password) / 3));
-    char *str_newpass = malloc(sizeof(char) * length);
+    char *str_newpass = malloc(sizeof(char) * (length + 1));
 
     if (NULL == str_newpass) {
         fprintf(stderr,
@@ -196,6 +425,67 @@ void with_capitilised_words(char *str_password)
 
 }
 
+/**
+ * @brief Select the random number generator backend requested via command line option '--rng <name>', or 'auto'
+ * when not given. The option is removed from the command line args so the remaining options can be checked as usual.
+ * @param argc : pointer to the number of command line arguments - reduced if the option is found.
+ * @param argv : array of command line arguments - the option and its value are removed if found.
+ * @return no return
+ */
+void set_rng_backend(int *argc, char **argv)
+{
+    const char *name = "auto";
+
+    for (int i = 1; i < *argc; i++) {
+        if (strcmp(argv[i], "--rng") != 0) {
+            continue;
+        }
+        if (i + 1 >= *argc) {
+            fprintf(stderr, "Error: option '--rng' requires one of: %s\n", rng_backend_list());
+            exit(EXIT_FAILURE);
+        }
+        name = argv[i + 1];
+        /* remove the option and its value, including the terminating NULL held in `argv[argc]` */
+        for (int j = i; j + 2 <= *argc; j++) {
+            argv[j] = argv[j + 2];
+        }
+        *argc -= 2;
+        break;
+    }
+
+    if (rng_select(name) != 0) {
+        fprintf(stderr, "Error: random number generator '%s' is unknown or not available. Use one of: %s\n",
+                name, rng_backend_list());
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * @brief Open the optional password history store so no password is offered more than once across runs.
+ * @param OPASS_HISTORY : obtained from user set environment variable as the path of the store. Not used if unset.
+ * @return no return
+ */
+void set_history_store(void)
+{
+    if (getenv("OPASS_HISTORY")) {
+        history_open(getenv("OPASS_HISTORY"), 1);
+        atexit(history_close);
+    }
+}
+
+/**
+ * @brief Report that no new password could be found that is not already in the history store, and exit the program.
+ * @return no return
+ */
+static void history_exhausted(void)
+{
+    fprintf(stderr,
+            "Error: unable to generate a password not already in the history store after '%d' attempts.\n"
+            "Increase the number of words used via 'OPASS_WORDS'.\n",
+            HISTORY_MAX_ATTEMPTS);
+    exit(EXIT_FAILURE);
+}
+
 /**
  * @brief Quick output was requested via command line option '-q' or '--quick'
  * @param wordsRequired : the number of three letter words to include in output
@@ -204,7 +494,11 @@ void with_capitilised_words(char *str_password)
  */
 void get_quick(int wordsRequired, int wordArraySize)
 {
+    set_history_store();
     char *newpass = get_random_password_str(wordsRequired, wordArraySize);
+    if (NULL == newpass) {
+        history_exhausted();
+    }
     printf("%s\n", newpass);
     free(newpass);
     newpass = NULL;
@@ -229,11 +523,13 @@ void set_nocolor_env()
 /* MAIN - Program starts here    */
 /*-------------------------------*/
 /**
- * @brief Main program start point for `opass`.
+ * @brief Main program start point for `opass`. Left out when built with `OPASS_NO_MAIN` so the functions
+ * above can be linked into the `opass_fuzz` test target.
  * @param argc : number of arguments included when the program was executed.
  * @param argv : array of user provided command line arguments.
  * @return : int indicating success or failure for programs execution.
  */
+#ifndef OPASS_NO_MAIN
 int main(int argc, char **argv)
 {
 
@@ -254,9 +550,8 @@ int main(int argc, char **argv)
     int const marksArraySize = sizeof(marks) / sizeof(int);
     assert(marksArraySize == 10);
 
-    /* seed random with the current time in seconds since the
-     * Epoch done once - used as is global value for programs life */
-    srandom(time(NULL));
+    /* select and seed the random number generator - once for the programs life */
+    set_rng_backend(&argc, argv);
 
     /** @note obtain any command line args from the user and action them */
     if (argc > 1) {
@@ -272,6 +567,10 @@ int main(int argc, char **argv)
         }
 
         if (strcmp(argv[1], "-v") == 0 || strcmp(argv[1], "--version") == 0) {
+            /* only an existing history store is opened - one is not created just to report it is empty */
+            if (getenv("OPASS_HISTORY") && history_open(getenv("OPASS_HISTORY"), 0) == 0) {
+                atexit(history_close);
+            }
             show_version(argv[0], numPassSuggestions, wordsRequired, version, wordArraySize, marksArraySize);
             return (EXIT_SUCCESS);
         }
@@ -285,36 +584,41 @@ int main(int argc, char **argv)
             return (EXIT_SUCCESS);
         }
 
+        if (strcmp(argv[1], "--coproc") == 0) {
+            run_coproc(wordsRequired,wordArraySize,marksArraySize);
+            return (EXIT_SUCCESS);
+        }
+
+        if (strcmp(argv[1], "--jobs") == 0) {
+            if (argc < 3) {
+                fprintf(stderr, "Error: option '--jobs' requires the path of a job manifest file.\n");
+                return (EXIT_FAILURE);
+            }
+            return run_jobs(argv[2],wordsRequired,wordArraySize,marksArraySize);
+        }
+
     }
 
     /** @section No command line options were provided by the user - so run the default action of
      *  generating and then displaying passwords for the user to select from.
      */
+    set_history_store();
+
     printf("Suggested passwords are:\n\n");
 
     for (int x = 1; x <= numPassSuggestions; x++) {
         /* get a base set of words to use as a password string: `*newpass` */
         char *newpass = get_random_password_str(wordsRequired,wordArraySize);
+        if (NULL == newpass) {
+            history_exhausted();
+        }
 
         #if DEBUG
         printf("DEBUG: '*newpass' length: %d\n",(int)strlen(newpass));
         #endif
 
-        /* size_t == length of 'newpass' + mark + random number */
-        size_t fullpass_sz = ( (sizeof(char) * strlen(newpass)) + (sizeof(char)) + (sizeof(char) *2 ) + 1);
-
-        #if DEBUG
-        printf("DEBUG: '*fullpass' length: %d\n",(int)fullpass_sz);
-        #endif
-
-        char *fullpass=malloc(fullpass_sz);
-
-        /** @note Create a `*fullpass` with component parts.
-         * The call to random is cast as `int` as Windows uses *rand/srand* alternative
-         * that returns `int` whereas other systems all use *srandom/random* from 'stdlib.h' library
-         * that returns a `long`. As only random numbers between 0 and 99 are being used, limiting
-         * the returned value to `int` from default `long` is safe. */
-        snprintf(fullpass,fullpass_sz,"%s%c%02d",newpass,(marks[(random() % marksArraySize)]),(int)(random() % 99));
+        /* add a random mark and number to the words to create the full password string: `*fullpass` */
+        char *fullpass = get_full_password_str(newpass,marksArraySize);
 
         /* output a word only version of the password with spaces between the word */
         if ((strlen(newpass) > 0) || (NULL != newpass)) {
@@ -338,3 +642,4 @@ int main(int argc, char **argv)
 
     return EXIT_SUCCESS;
 }
+#endif // OPASS_NO_MAIN
@@ -18,25 +18,19 @@
 #ifndef OPASS_H_
 #define OPASS_H_
 
-// TODO : fix missing 'random' and 'srandom' in some 'stdlib.h' libraries
-//#define random rand
-//#define srandom srand
-
 // display password program output
 #include "output.h"
+// generate the password strings
+#include "password.h"
 
 #define MAX_PASSWORDS 5
 #define MAX_WORDS 3
 #define VERSION "1.2.0";
 
 
-char *get_random_password_str(int wordsRequired, int wordArraySize);
 void get_quick(int wordsRequired, int wordArraySize);
-int set_number_passwords(void);
-int set_number_words(void);
-void with_spaces(char *str_password);
-void with_capitilised_words(char *str_password);
 void set_nocolor_env();
+void set_rng_backend(int *argc, char **argv);
 
 
 /**
@@ -9,6 +9,8 @@
  */
 
 #include "output.h"
+#include "rng.h"
+#include "history.h"
 
 #include <stdio.h>   /* printf */
 #include <stdlib.h>  /* getenv */
@@ -89,10 +91,17 @@ void show_help() {
            "  -h, --help       Show this help information.\n"
            "  -n, --nocolor    No colour output with the passwords displayed.\n"
            "  -q, --quick      Just offer a password and no other output.\n"
-           "  -v, --version    Display the version of the program and password stats.\n\n"
+           "  --coproc         Answer password requests read line by line from stdin, eg: 'words=4 count=10'.\n"
+           "  --jobs <file>    Run every job in a tab separated manifest: name, words, count, format, output.\n"
+           "  -v, --version    Display the version of the program and password stats.\n"
+           "  --rng <name>     Random number generator to use: auto (default), libc, getrandom, rdrand.\n"
+           "                   The 'auto' choice times getrandom and rdrand at startup and uses the fastest;\n"
+           "                   libc is only used when named, or when neither is available.\n\n"
            "Other options are configured via environment variables:\n\n"
            "OPASS_WORDS        Set the number of three letter words to include in a password.\n"
            "OPASS_NUM          Set the number of passwords to generate.\n"
+           "OPASS_HISTORY      Path of a history store used to never offer the same password twice.\n"
+           "OPASS_THREADS      Set the number of worker threads used by '--jobs'. Default is one per CPU.\n"
            "NO_COLOR           set if colour output is to be excluded. Also set via '-n' flag.\n\n"
            "These can be set in the shell, or just given when needed on the command line.\n\n"
            "Example usage 1:  opass\n"
@@ -152,7 +161,8 @@ void show_version(const char *program_name, const int numPassSuggestions, const
     printf("\n'%s' is version: '%s'.\n", program_name, version);
     printf("Compiled on: '%s @ %s'.\n",__DATE__,__TIME__);
     puts("Copyright (c) 2021 Simon Rowe.\n");
-    printf("C source built as '%s' using compiler '%s'.\n\n",Build_Type,compilerVersion);
+    printf("C source built as '%s' using compiler '%s'.\n",Build_Type,compilerVersion);
+    printf("Random number generator in use: '%s' (available: %s).\n\n",rng_name(),rng_backend_list());
     puts("For licenses and further information visit:");
     puts("- https://github.com/wiremoons/opass/");
 
@@ -160,6 +170,15 @@ void show_version(const char *program_name, const int numPassSuggestions, const
         puts("\n'NO_COLOR' environment exist as: https://no-color.org/");
     }
 
+    if ( getenv("OPASS_HISTORY") ) {
+        if ( history_entries() < 0 ) {
+            printf("\nPassword history store in use: '%s' - not yet created.\n", getenv("OPASS_HISTORY"));
+        } else {
+            printf("\nPassword history store in use: '%s' holding '%ld' passwords.\n", getenv("OPASS_HISTORY"),
+                   history_entries());
+        }
+    }
+
     /* display some stats about passwords being generated */
     printf("\nApplication Password Stats:\n");
     printf("  - Number of three letter words available: ");
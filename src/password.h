@@ -0,0 +1,38 @@
+/**
+ * @file password.h
+ * @brief Offer Password (opass): functions used to generate the password strings, shared by the different
+ * ways opass can be run.
+ *
+ * @author:     simon rowe <simon@wiremoons.com>
+ * @license:    open-source released under "MIT License"
+ * @source:     https://github.com/wiremoons/opass
+ *
+ * @date originally created: 18 Oct 2026
+ *
+ * The program is licensed under the "*MIT License*" see
+ * http://opensource.org/licenses/MIT for more details.
+ *
+ */
+
+#ifndef OPASS_PASSWORD_H
+#define OPASS_PASSWORD_H
+
+#include "format.h"
+
+/** @note number of passwords checked against the history store together by `get_formatted_passwords()` */
+#define PASSWORD_BATCH_SIZE 64
+
+char *get_random_password_str(int wordsRequired, int wordArraySize);
+char *get_full_password_str(const char *str_password, int marksArraySize);
+size_t get_formatted_password(enum password_format format, int wordsRequired, int wordArraySize, int marksArraySize,
+                              char *out);
+size_t get_formatted_passwords(enum password_format format, int wordsRequired, int wordArraySize, int marksArraySize,
+                               int count, char *out, int *written);
+int set_number_passwords(void);
+int set_number_words(void);
+void with_spaces(char *str_password);
+void with_capitilised_words(char *str_password);
+void set_history_store(void);
+
+
+#endif //OPASS_PASSWORD_H
@@ -0,0 +1,395 @@
+/*
+ * Offer Password (opass): rng.c
+ *
+ * Random number generator backends for opass. See: https://github.com/wiremoons/opass
+ *
+ * Backends available:
+ *   libc      : `srandom()` / `random()` seeded with the current time - the original opass source.
+ *   getrandom : the Linux kernel CSPRNG via `getrandom()`, read in buffered blocks to limit system calls.
+ *   rdrand    : the x86 `RDRAND` instruction, with two outputs combined and mixed for each value returned.
+ *
+ * All backends return values between 0 and 2^31 - 1, the same range as `random()`.
+ *
+ * MIT License
+ *
+ */
+
+#define _DEFAULT_SOURCE
+
+#include "rng.h"
+
+#include <stdio.h>   /* fprintf */
+#include <stdlib.h>  /* srandom, random */
+#include <string.h>  /* strcmp */
+#include <time.h>    /* time, timespec_get */
+#include <errno.h>   /* errno, EINTR */
+#include <pthread.h> /* pthread_once */
+
+#if defined(__linux__)
+#include <unistd.h>       /* syscall */
+#include <sys/syscall.h>  /* SYS_getrandom */
+#endif
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <cpuid.h>  /* __get_cpuid */
+#define OPASS_HAVE_RDRAND 1
+#endif
+
+#define RNG_MASK 0x7fffffffU
+
+/*-------------------------------*/
+/* libc - srandom / random       */
+/*-------------------------------*/
+
+static int libc_available(void)
+{
+    return 1;
+}
+
+static void libc_seed(void)
+{
+    /* seed random with the current time in seconds since the
+     * Epoch done once - used as is global value for programs life */
+    srandom(time(NULL));
+}
+
+static uint32_t libc_next(void)
+{
+    return (uint32_t)random() & RNG_MASK;
+}
+
+/*-------------------------------*/
+/* getrandom - buffered syscall  */
+/*-------------------------------*/
+
+#if defined(__linux__) && defined(SYS_getrandom)
+
+/** @var per thread buffer of kernel provided random numbers, refilled with one system call when empty */
+static _Thread_local uint32_t getrandom_buf[1024];
+static _Thread_local size_t getrandom_pos = sizeof(getrandom_buf) / sizeof(getrandom_buf[0]);
+
+static int getrandom_available(void)
+{
+    uint32_t probe;
+    return syscall(SYS_getrandom, &probe, sizeof(probe), 0) == (long)sizeof(probe);
+}
+
+static void getrandom_seed(void)
+{
+    getrandom_pos = sizeof(getrandom_buf) / sizeof(getrandom_buf[0]);
+}
+
+static uint32_t getrandom_next(void)
+{
+    if (getrandom_pos == sizeof(getrandom_buf) / sizeof(getrandom_buf[0])) {
+        size_t got = 0;
+        while (got < sizeof(getrandom_buf)) {
+            long n = syscall(SYS_getrandom, (char *)getrandom_buf + got, sizeof(getrandom_buf) - got, 0);
+            /* reads larger than 256 bytes can be interrupted by a signal before any bytes are returned */
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                fprintf(stderr, "Error reading from 'getrandom()' in function 'getrandom_next()' in file '%s' at line '%d'.\n",
+                        __FILE__, __LINE__);
+                exit(EXIT_FAILURE);
+            }
+            got += (size_t)n;
+        }
+        getrandom_pos = 0;
+    }
+    return getrandom_buf[getrandom_pos++] & RNG_MASK;
+}
+
+#else
+
+static int getrandom_available(void)
+{
+    return 0;
+}
+
+static void getrandom_seed(void)
+{
+}
+
+static uint32_t getrandom_next(void)
+{
+    return 0;
+}
+
+#endif
+
+/*-------------------------------*/
+/* rdrand - x86 hardware RNG     */
+/*-------------------------------*/
+
+#if defined(OPASS_HAVE_RDRAND)
+
+/** @var the second half of the last mixed 64 bit value, returned by the following call */
+static _Thread_local uint64_t rdrand_spare;
+static _Thread_local int rdrand_have_spare = 0;
+
+static void rdrand_seed(void)
+{
+    rdrand_have_spare = 0;
+}
+
+/**
+ * @brief Obtain one 64 bit value from the `RDRAND` instruction, retrying as recommended by Intel if the
+ * hardware has not yet got a value ready.
+ * @param value : set to the raw 64 bit hardware random value.
+ * @return int : one if a value was obtained, otherwise zero.
+ */
+static int rdrand64_try(uint64_t *value)
+{
+    for (int retry = 0; retry < 10; retry++) {
+        unsigned char ok;
+        __asm__ __volatile__("rdrand %0; setc %1" : "=r"(*value), "=qm"(ok) : : "cc");
+        if (ok) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Obtain one 64 bit value from the `RDRAND` instruction, exiting the program if none is available.
+ * @return the raw 64 bit hardware random value.
+ */
+static uint64_t rdrand64(void)
+{
+    uint64_t value;
+    if (!rdrand64_try(&value)) {
+        fprintf(stderr, "Error: 'RDRAND' failed to return a value in function 'rdrand64()' in file '%s' at line '%d'.\n",
+                __FILE__, __LINE__);
+        exit(EXIT_FAILURE);
+    }
+    return value;
+}
+
+/**
+ * @brief Check if the `RDRAND` instruction is supported, and is working.
+ * @return int : one if `RDRAND` can be used, otherwise zero.
+ */
+static int rdrand_available(void)
+{
+    static int checked = 0;
+    static int working = 0;
+    unsigned int eax, ebx, ecx, edx;
+
+    if (checked) {
+        return working;
+    }
+    checked = 1;
+
+    /* CPUID leaf 1 : ECX bit 30 is set when the RDRAND instruction is supported */
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || (ecx & (1U << 30)) == 0) {
+        return 0;
+    }
+
+    /* some CPUs with broken firmware report success but always return all ones - reject RDRAND if any of a
+     * few values is all ones, or they are all the same */
+    uint64_t first;
+    working = rdrand64_try(&first) && first != ~0ULL;
+    for (int i = 1; i < RNG_RDRAND_CHECKS && working; i++) {
+        uint64_t value;
+        if (!rdrand64_try(&value) || value == ~0ULL || value == first) {
+            working = 0;
+        }
+    }
+    return working;
+}
+
+static uint32_t rdrand_next(void)
+{
+    if (rdrand_have_spare) {
+        rdrand_have_spare = 0;
+        return (uint32_t)(rdrand_spare >> 32) & RNG_MASK;
+    }
+
+    /* condition the hardware output: combine two values then mix the bits (MurmurHash3 finaliser) so any
+     * bias in a single value is spread over the whole result */
+    uint64_t x = rdrand64() ^ (rdrand64() * 0x9e3779b97f4a7c15ULL);
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+
+    rdrand_spare = x;
+    rdrand_have_spare = 1;
+    return (uint32_t)x & RNG_MASK;
+}
+
+#else
+
+static int rdrand_available(void)
+{
+    return 0;
+}
+
+static void rdrand_seed(void)
+{
+}
+
+static uint32_t rdrand_next(void)
+{
+    return 0;
+}
+
+#endif
+
+/*-------------------------------*/
+/* backend selection             */
+/*-------------------------------*/
+
+/** @var all backends known to opass - availability is checked at runtime */
+static const struct rng_backend backends[] = {
+    {"libc", 0, libc_available, libc_seed, libc_next},
+    {"getrandom", 1, getrandom_available, getrandom_seed, getrandom_next},
+    {"rdrand", 1, rdrand_available, rdrand_seed, rdrand_next},
+};
+
+/** @var the backend in use - defaults to `libc` until `rng_select()` is called */
+static const struct rng_backend *active = &backends[0];
+
+/**
+ * @brief Time a backend drawing `RNG_BENCH_DRAWS` random numbers.
+ * @param backend : the seeded backend to be timed.
+ * @return double : the elapsed time in nanoseconds.
+ */
+static double rng_bench(const struct rng_backend *backend)
+{
+    struct timespec start, end;
+    volatile uint32_t sink = 0;
+
+    timespec_get(&start, TIME_UTC);
+    for (int i = 0; i < RNG_BENCH_DRAWS; i++) {
+        sink ^= backend->next();
+    }
+    timespec_get(&end, TIME_UTC);
+    (void)sink;
+
+    return ((double)(end.tv_sec - start.tv_sec) * 1e9) + (double)(end.tv_nsec - start.tv_nsec);
+}
+
+/** @var set once `auto` was requested - the choice is then made by the first call to `rng_next()` or `rng_name()` */
+static int auto_pending = 0;
+static pthread_once_t auto_once = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief Time the available cryptographic backends and use the fastest, or `libc` if none is available. Run
+ * once via `pthread_once()` so program paths that never draw a random number do not pay for the timing.
+ * @return no return
+ */
+static void rng_select_auto(void)
+{
+    int const count = sizeof(backends) / sizeof(backends[0]);
+    double best_time = 0.0;
+    const struct rng_backend *best = NULL;
+
+    for (int i = 0; i < count; i++) {
+        if (!backends[i].cryptographic || !backends[i].available()) {
+            continue;
+        }
+        backends[i].seed();
+        /* the fastest of a few runs is used so a single interrupted run does not decide the choice */
+        double elapsed = 0.0;
+        for (int run = 0; run < RNG_BENCH_RUNS; run++) {
+            double run_time = rng_bench(&backends[i]);
+            if (run == 0 || run_time < elapsed) {
+                elapsed = run_time;
+            }
+        }
+        #if DEBUG
+        printf("DEBUG: rng backend '%s' took %.0f ns for %d draws (fastest of %d runs)\n", backends[i].name,
+               elapsed, RNG_BENCH_DRAWS, RNG_BENCH_RUNS);
+        #endif
+        if (best == NULL || elapsed < best_time) {
+            best_time = elapsed;
+            best = &backends[i];
+        }
+    }
+    if (best == NULL) {
+        best = &backends[0];
+    }
+    #if DEBUG
+    printf("DEBUG: rng backend '%s' selected by 'auto'\n", best->name);
+    #endif
+    active = best;
+    active->seed();
+}
+
+/**
+ * @brief Select and seed the random number generator backend to use.
+ * @param name : the name of a backend, or `auto` to time the available cryptographic backends and use the
+ * fastest. `auto` only falls back to `libc` when no cryptographic backend is available on this computer. The
+ * timing is left until the first random number is needed.
+ * @return int : zero on success, or minus one (-1) if the backend is unknown or not available on this computer.
+ */
+int rng_select(const char *name)
+{
+    int const count = sizeof(backends) / sizeof(backends[0]);
+
+    if (strcmp(name, "auto") == 0) {
+        auto_pending = 1;
+        return 0;
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (strcmp(name, backends[i].name) == 0) {
+            if (!backends[i].available()) {
+                return -1;
+            }
+            auto_pending = 0;
+            active = &backends[i];
+            active->seed();
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief The name of the backend in use.
+ * @return the backends name.
+ */
+const char *rng_name(void)
+{
+    if (auto_pending) {
+        pthread_once(&auto_once, rng_select_auto);
+    }
+    return active->name;
+}
+
+/**
+ * @brief A space separated list of the backends available on this computer, for use in help and error output.
+ * @return the list of names, including `auto`.
+ */
+const char *rng_backend_list(void)
+{
+    static char list[64] = "";
+
+    if (list[0] == '\0') {
+        strcat(list, "auto");
+        for (size_t i = 0; i < sizeof(backends) / sizeof(backends[0]); i++) {
+            if (backends[i].available()) {
+                strcat(list, " ");
+                strcat(list, backends[i].name);
+            }
+        }
+    }
+    return list;
+}
+
+/**
+ * @brief Obtain the next random number from the backend in use.
+ * @return uint32_t : a random number between 0 and 2^31 - 1.
+ */
+uint32_t rng_next(void)
+{
+    if (auto_pending) {
+        pthread_once(&auto_once, rng_select_auto);
+    }
+    return active->next();
+}
@@ -0,0 +1,47 @@
+/**
+ * @file rng.h
+ * @brief Offer Password (opass): selectable random number generator backends used to pick words, marks
+ * and numbers for the generated passwords.
+ *
+ * @author:     simon rowe <simon@wiremoons.com>
+ * @license:    open-source released under "MIT License"
+ * @source:     https://github.com/wiremoons/opass
+ *
+ * @date originally created: 18 Oct 2026
+ *
+ * The program is licensed under the "*MIT License*" see
+ * http://opensource.org/licenses/MIT for more details.
+ *
+ */
+
+#ifndef OPASS_RNG_H
+#define OPASS_RNG_H
+
+#include <stdint.h>
+
+/** @note number of random numbers drawn from each backend when `auto` selection times them at startup */
+#define RNG_BENCH_DRAWS 64
+/** @note number of times each backend is timed by `auto` selection - the fastest time is used */
+#define RNG_BENCH_RUNS 3
+/** @note number of values checked from `RDRAND` at startup before it is trusted */
+#define RNG_RDRAND_CHECKS 8
+
+/**
+ *  `struct rng_backend` : a source of random numbers. Each backend is checked as available on the
+ *  current computer at runtime before being seeded and used. Only `cryptographic` backends are chosen by `auto`.
+ */
+struct rng_backend {
+    const char *name;
+    int cryptographic;
+    int (*available)(void);
+    void (*seed)(void);
+    uint32_t (*next)(void);
+};
+
+int rng_select(const char *name);
+const char *rng_name(void);
+const char *rng_backend_list(void);
+uint32_t rng_next(void);
+
+
+#endif //OPASS_RNG_H